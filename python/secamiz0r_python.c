@@ -0,0 +1,557 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_python.c: CPython extension module.
+ *
+ *     import numpy as np, secamiz0r
+ *     f = secamiz0r.Filter(1920, 1080, fire=0.5)
+ *     out = np.asarray(f.process(frames))  # frames: (N, 1080, 1920, 4) uint8
+ *
+ * Frames are read from and written to any contiguous buffer as they are,
+ * and the GIL is released while filtering. Batches are split between
+ * threads frame by frame, each thread with its own filter instance.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "secamiz0r.h"
+
+#ifdef SECAMIZ0R_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/**
+ * secamiz0r.Filter object.
+ */
+struct filter
+{
+    PyObject_HEAD
+
+    unsigned int width;
+    unsigned int height;
+    double fire_intensity;
+    double noise_intensity;
+    unsigned int thread_count;
+    size_t next_frame;
+
+    // Instance for single frames, splits each frame between threads.
+    f0r_instance_t instance;
+
+    // Single-threaded instances for batches, created on demand.
+    f0r_instance_t *batch;
+    unsigned int batch_count;
+
+    // Only one call at a time works with the instances.
+    PyThread_type_lock lock;
+};
+
+/**
+ * Part of a batch filtered by one thread: every n-th frame from the first.
+ */
+struct batch_job
+{
+    f0r_instance_t instance;
+    uint8_t const *src;
+    uint8_t *dst;
+    size_t frame_size;
+    size_t first_frame;
+    size_t frame_count;
+    size_t start;
+    size_t step;
+#ifdef SECAMIZ0R_THREADS
+    pthread_t thread;
+#endif
+};
+
+static void *run_batch_job(void *arg)
+{
+    struct batch_job *job = arg;
+
+    for (size_t i = job->start; i < job->frame_count; i += job->step) {
+        secamiz0r_update_frame(job->instance, job->first_frame + i,
+                               &job->src[i * job->frame_size], SECAMIZ0R_FORMAT_RGBA8888,
+                               &job->dst[i * job->frame_size], SECAMIZ0R_FORMAT_RGBA8888);
+    }
+
+    return NULL;
+}
+
+static void set_params(struct filter *self, f0r_instance_t instance)
+{
+    f0r_set_param_value(instance, &self->fire_intensity, 0);
+    f0r_set_param_value(instance, &self->noise_intensity, 1);
+}
+
+/**
+ * Make sure there are enough instances for the batch, one per thread.
+ * Called with both the GIL and the lock held.
+ */
+static int ensure_batch(struct filter *self, unsigned int count)
+{
+    if (self->batch_count >= count) {
+        return 1;
+    }
+
+    f0r_instance_t *batch = PyMem_Realloc(self->batch, sizeof(*batch) * count);
+
+    if (!batch) {
+        PyErr_NoMemory();
+        return 0;
+    }
+
+    self->batch = batch;
+
+    while (self->batch_count < count) {
+        f0r_instance_t instance = f0r_construct(self->width, self->height);
+
+        if (!instance) {
+            PyErr_NoMemory();
+            return 0;
+        }
+
+        secamiz0r_set_threads(instance, 1);
+        self->batch[self->batch_count++] = instance;
+    }
+
+    return 1;
+}
+
+/**
+ * Filter frames without the GIL. A single frame is split between threads
+ * by the instance itself, a batch is split frame by frame.
+ */
+static void run_batch(struct filter *self, uint8_t const *src, uint8_t *dst, size_t frame_count, size_t first_frame, unsigned int thread_count)
+{
+    size_t const frame_size = secamiz0r_frame_size(self->width, self->height, SECAMIZ0R_FORMAT_RGBA8888);
+
+    if (thread_count <= 1) {
+        set_params(self, self->instance);
+
+        for (size_t i = 0; i < frame_count; i++) {
+            secamiz0r_update_frame(self->instance, first_frame + i,
+                                   &src[i * frame_size], SECAMIZ0R_FORMAT_RGBA8888,
+                                   &dst[i * frame_size], SECAMIZ0R_FORMAT_RGBA8888);
+        }
+
+        return;
+    }
+
+    struct batch_job jobs[64];
+
+    for (unsigned int i = 0; i < thread_count; i++) {
+        struct batch_job *job = &jobs[i];
+
+        set_params(self, self->batch[i]);
+
+        job->instance = self->batch[i];
+        job->src = src;
+        job->dst = dst;
+        job->frame_size = frame_size;
+        job->first_frame = first_frame;
+        job->frame_count = frame_count;
+        job->start = i;
+        job->step = thread_count;
+    }
+
+#ifdef SECAMIZ0R_THREADS
+    unsigned int started = 1;
+
+    for (; started < thread_count; started++) {
+        if (pthread_create(&jobs[started].thread, NULL, run_batch_job, &jobs[started]) != 0) {
+            break;
+        }
+    }
+
+    // Jobs which failed to start are done right here.
+    for (unsigned int i = started; i < thread_count; i++) {
+        run_batch_job(&jobs[i]);
+    }
+
+    run_batch_job(&jobs[0]);
+
+    for (unsigned int i = 1; i < started; i++) {
+        pthread_join(jobs[i].thread, NULL);
+    }
+#else
+    for (unsigned int i = 0; i < thread_count; i++) {
+        run_batch_job(&jobs[i]);
+    }
+#endif
+}
+
+/**
+ * Number of frames in the buffer, checking its item type, and its shape
+ * if it has one. The buffer must be taken with PyBUF_FORMAT.
+ */
+static Py_ssize_t get_frame_count(struct filter *self, Py_buffer const *view, char const *name)
+{
+    size_t const frame_size = secamiz0r_frame_size(self->width, self->height, SECAMIZ0R_FORMAT_RGBA8888);
+
+    // No format means unsigned bytes.
+    if (view->itemsize != 1 || (view->format && strcmp(view->format, "B"))) {
+        PyErr_Format(PyExc_TypeError, "%s must be a buffer of unsigned bytes (format 'B'), not '%s'",
+                     name, view->format ? view->format : "B");
+        return -1;
+    }
+
+    if (view->ndim >= 3) {
+        Py_ssize_t const *shape = &view->shape[view->ndim - 3];
+
+        if (view->ndim > 4
+            || shape[0] != (Py_ssize_t) self->height || shape[1] != (Py_ssize_t) self->width || shape[2] != 4) {
+            PyErr_Format(PyExc_ValueError, "%s must be uint8 with shape (%u, %u, 4) or (N, %u, %u, 4)",
+                         name, self->height, self->width, self->height, self->width);
+            return -1;
+        }
+    }
+
+    if (view->len == 0 || (size_t) view->len % frame_size) {
+        PyErr_Format(PyExc_ValueError, "size of %s must be a multiple of %zu bytes", name, frame_size);
+        return -1;
+    }
+
+    return (Py_ssize_t) ((size_t) view->len / frame_size);
+}
+
+/**
+ * Output buffer shaped like the input: memoryview of a new bytearray.
+ */
+static PyObject *new_output(Py_buffer const *src, Py_buffer *dst)
+{
+    PyObject *array = PyByteArray_FromStringAndSize(NULL, src->len);
+
+    if (!array) {
+        return NULL;
+    }
+
+    PyObject *view = PyMemoryView_FromObject(array);
+    Py_DECREF(array);
+
+    if (!view) {
+        return NULL;
+    }
+
+    if (src->ndim > 1 && src->shape) {
+        PyObject *shape = PyTuple_New(src->ndim);
+
+        if (!shape) {
+            Py_DECREF(view);
+            return NULL;
+        }
+
+        for (int i = 0; i < src->ndim; i++) {
+            PyTuple_SET_ITEM(shape, i, PyLong_FromSsize_t(src->shape[i]));
+        }
+
+        PyObject *cast = PyObject_CallMethod(view, "cast", "sO", "B", shape);
+        Py_DECREF(shape);
+        Py_DECREF(view);
+
+        if (!cast) {
+            return NULL;
+        }
+
+        view = cast;
+    }
+
+    if (PyObject_GetBuffer(view, dst, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0) {
+        Py_DECREF(view);
+        return NULL;
+    }
+
+    return view;
+}
+
+PyDoc_STRVAR(filter_process_doc,
+"process(src, dst=None, first_frame=None)\n"
+"--\n\n"
+"Filter one frame of shape (H, W, 4) or a batch of shape (N, H, W, 4),\n"
+"or any contiguous buffer of RGBA frames, all of unsigned bytes (uint8,\n"
+"format 'B'); other item types raise TypeError. Output goes to dst if given\n"
+"(it must not overlap src), otherwise to a new memoryview shaped like\n"
+"src. Frames are numbered from first_frame, which defaults to the frame\n"
+"after the last one filtered. Returns the output.");
+
+static PyObject *filter_process(struct filter *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = { "src", "dst", "first_frame", NULL };
+
+    PyObject *src_object;
+    PyObject *dst_object = Py_None;
+    PyObject *first_frame_object = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OO", keywords, &src_object, &dst_object, &first_frame_object)) {
+        return NULL;
+    }
+
+    size_t first_frame = self->next_frame;
+
+    if (first_frame_object != Py_None) {
+        first_frame = PyLong_AsSize_t(first_frame_object);
+
+        if (first_frame == (size_t) -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+    }
+
+    Py_buffer src;
+    Py_buffer dst;
+    PyObject *result;
+
+    if (PyObject_GetBuffer(src_object, &src, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) {
+        return NULL;
+    }
+
+    Py_ssize_t const frame_count = get_frame_count(self, &src, "src");
+
+    if (frame_count < 0) {
+        PyBuffer_Release(&src);
+        return NULL;
+    }
+
+    if (dst_object == Py_None) {
+        result = new_output(&src, &dst);
+    } else if (PyObject_GetBuffer(dst_object, &dst, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) {
+        result = NULL;
+    } else if (get_frame_count(self, &dst, "dst") != frame_count) {
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(PyExc_ValueError, "src and dst must have the same number of frames");
+        }
+
+        PyBuffer_Release(&dst);
+        result = NULL;
+    } else {
+        Py_INCREF(dst_object);
+        result = dst_object;
+    }
+
+    if (!result) {
+        PyBuffer_Release(&src);
+        return NULL;
+    }
+
+    unsigned int thread_count = 1;
+
+    if (frame_count > 1) {
+        thread_count = ((Py_ssize_t) self->thread_count < frame_count) ? self->thread_count : (unsigned int) frame_count;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    Py_END_ALLOW_THREADS
+
+    if (thread_count > 1 && !ensure_batch(self, thread_count)) {
+        PyThread_release_lock(self->lock);
+        PyBuffer_Release(&dst);
+        PyBuffer_Release(&src);
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    run_batch(self, src.buf, dst.buf, (size_t) frame_count, first_frame, thread_count);
+    Py_END_ALLOW_THREADS
+
+    self->next_frame = first_frame + (size_t) frame_count;
+    PyThread_release_lock(self->lock);
+
+    PyBuffer_Release(&dst);
+    PyBuffer_Release(&src);
+
+    return result;
+}
+
+static int filter_init(struct filter *self, PyObject *args, PyObject *kwargs)
+{
+    static char *keywords[] = { "width", "height", "fire", "noise", "threads", NULL };
+
+    unsigned int width;
+    unsigned int height;
+    double fire_intensity = 0.125;
+    double noise_intensity = 0.125;
+    unsigned int thread_count = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "II|ddI", keywords,
+                                     &width, &height, &fire_intensity, &noise_intensity, &thread_count)) {
+        return -1;
+    }
+
+    if (width == 0 || height == 0 || (width % 2) || (height % 2)) {
+        PyErr_SetString(PyExc_ValueError, "width and height must be even and positive");
+        return -1;
+    }
+
+    if (self->instance) {
+        PyErr_SetString(PyExc_RuntimeError, "Filter is already initialized");
+        return -1;
+    }
+
+#ifdef SECAMIZ0R_THREADS
+    if (thread_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = (cpus > 0) ? (unsigned int) cpus : 1;
+    }
+#else
+    thread_count = 1;
+#endif
+
+    self->width = width;
+    self->height = height;
+    self->fire_intensity = fire_intensity;
+    self->noise_intensity = noise_intensity;
+    self->thread_count = (thread_count < 64) ? thread_count : 64;
+    self->next_frame = 0;
+    self->lock = PyThread_allocate_lock();
+    self->instance = f0r_construct(width, height);
+
+    if (!self->lock || !self->instance || !secamiz0r_set_threads(self->instance, self->thread_count)) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    return 0;
+}
+
+static void filter_dealloc(struct filter *self)
+{
+    for (unsigned int i = 0; i < self->batch_count; i++) {
+        f0r_destruct(self->batch[i]);
+    }
+
+    PyMem_Free(self->batch);
+
+    if (self->instance) {
+        f0r_destruct(self->instance);
+    }
+
+    if (self->lock) {
+        PyThread_free_lock(self->lock);
+    }
+
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *filter_get_fire(struct filter *self, void *closure)
+{
+    return PyFloat_FromDouble(self->fire_intensity);
+}
+
+static int filter_set_fire(struct filter *self, PyObject *value, void *closure)
+{
+    double x = value ? PyFloat_AsDouble(value) : -1.0;
+
+    if (x == -1.0 && (!value || PyErr_Occurred())) {
+        if (!value) {
+            PyErr_SetString(PyExc_AttributeError, "can't delete fire");
+        }
+        return -1;
+    }
+
+    self->fire_intensity = x;
+    return 0;
+}
+
+static PyObject *filter_get_noise(struct filter *self, void *closure)
+{
+    return PyFloat_FromDouble(self->noise_intensity);
+}
+
+static int filter_set_noise(struct filter *self, PyObject *value, void *closure)
+{
+    double x = value ? PyFloat_AsDouble(value) : -1.0;
+
+    if (x == -1.0 && (!value || PyErr_Occurred())) {
+        if (!value) {
+            PyErr_SetString(PyExc_AttributeError, "can't delete noise");
+        }
+        return -1;
+    }
+
+    self->noise_intensity = x;
+    return 0;
+}
+
+static PyObject *filter_get_next_frame(struct filter *self, void *closure)
+{
+    return PyLong_FromSize_t(self->next_frame);
+}
+
+static PyMethodDef filter_methods[] = {
+    { "process", (PyCFunction) (void (*)(void)) filter_process, METH_VARARGS | METH_KEYWORDS, filter_process_doc },
+    { NULL },
+};
+
+static PyGetSetDef filter_getset[] = {
+    { "fire", (getter) filter_get_fire, (setter) filter_set_fire, "Fire intensity, 0 to 1.", NULL },
+    { "noise", (getter) filter_get_noise, (setter) filter_set_noise, "Noise intensity, 0 to 1.", NULL },
+    { "next_frame", (getter) filter_get_next_frame, NULL, "Index of the frame process() filters next.", NULL },
+    { NULL },
+};
+
+PyDoc_STRVAR(filter_doc,
+"Filter(width, height, fire=0.125, noise=0.125, threads=0)\n"
+"--\n\n"
+"SECAM fire filter for RGBA frames of the given size. threads is the\n"
+"number of threads to use, 0 means one per CPU.");
+
+static PyTypeObject filter_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "secamiz0r.Filter",
+    .tp_doc = filter_doc,
+    .tp_basicsize = sizeof(struct filter),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc) filter_init,
+    .tp_dealloc = (destructor) filter_dealloc,
+    .tp_methods = filter_methods,
+    .tp_getset = filter_getset,
+};
+
+static struct PyModuleDef secamiz0r_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "secamiz0r",
+    .m_doc = "SECAM fire effect.",
+    .m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_secamiz0r(void)
+{
+    if (PyType_Ready(&filter_type) < 0) {
+        return NULL;
+    }
+
+    PyObject *module = PyModule_Create(&secamiz0r_module);
+
+    if (!module) {
+        return NULL;
+    }
+
+    Py_INCREF(&filter_type);
+
+    if (PyModule_AddObject(module, "Filter", (PyObject *) &filter_type) < 0) {
+        Py_DECREF(&filter_type);
+        Py_DECREF(module);
+        return NULL;
+    }
+
+    return module;
+}
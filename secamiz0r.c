@@ -23,9 +23,93 @@
  */
 
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "frei0r.h"
+#include "secamiz0r.h"
+
+#ifdef SECAMIZ0R_THREADS
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#endif
+
+#ifdef SECAMIZ0R_USDT
+#include <sys/sdt.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <direct.h>
+#define DIRECTORY_SEPARATOR '\\'
+#else
+#include <sys/stat.h>
+#define DIRECTORY_SEPARATOR '/'
+#endif
+
+/**
+ * Random generators are reseeded every this many pixels, so that any part
+ * of a line can be processed without running the generator from the start.
+ */
+#define RNG_BLOCK 256
+
+/**
+ * Very wide rows are split into segments of this width (a multiple of
+ * RNG_BLOCK) when filtering runs on several threads.
+ */
+#define SEGMENT_WIDTH 4096
+
+/**
+ * Pixels processed before and after a segment to get the state of the
+ * filter right at its edges. Fire decays within 80 pixels, prefilter
+ * oscillation and echo fade away by halving, chroma blur looks 8 pixels
+ * ahead of lines which may have been shifted 3 pixels to the left, so
+ * that their last pixels are blank. Warm-up is a multiple of RNG_BLOCK too.
+ */
+#define SEGMENT_WARMUP 768
+#define SEGMENT_TAIL 16
+
+/**
+ * Number of row pairs processed by a thread at once.
+ */
+#define BAND_PAIRS 8
+
+/**
+ * Size of a cache line, for keeping apart data written by different
+ * threads.
+ */
+#define CACHE_LINE 64
+
+/**
+ * Default size of the trace ring buffer, in events.
+ */
+#define TRACE_CAPACITY 262144
+
+/**
+ * Number of recent frames p99 latency is computed from.
+ */
+#define STATS_LATENCIES 1024
+
+/**
+ * Number of frames the autotuner filters with each configuration.
+ */
+#define AUTOTUNE_FRAMES 3
+
+/**
+ * Stages of the RGBA pipeline are forced inline, so that the compiler
+ * sees constant widths in the specialized kernels and can fully unroll
+ * and vectorize their loops.
+ */
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define ALWAYS_INLINE __forceinline
+#else
+#define ALWAYS_INLINE inline
+#endif
 
 /**
  * Limit integer value to the range.
@@ -109,14 +193,36 @@ static int juice(int j)
 }
 
 /**
- * secamiz0r instance struct.
+ * Scramble bits of an integer (lowbias32 hash by Chris Wellons).
  */
-struct secamiz0r
+static uint32_t hash32(uint32_t x)
 {
-    unsigned int width;
-    unsigned int height;
-    size_t frame_count;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
 
+    return x;
+}
+
+/**
+ * Counters behind the statistics parameter. Every worker keeps its own,
+ * they are summed up only when statistics are asked for.
+ */
+struct pair_stats
+{
+    uint64_t pixels;
+    uint64_t ignited;
+    uint64_t saturated;
+};
+
+/**
+ * Parameters as set by the user, and values derived from them which are
+ * used by filtering stages.
+ */
+struct params
+{
     double fire_intensity;
     int fire_threshold;
     int fire_seed;
@@ -127,27 +233,486 @@ struct secamiz0r
     int echo_offset;
 };
 
+/**
+ * Part of a row pair being filtered: which frame and which row pair it is,
+ * where it starts within the row and how wide it is, and with what
+ * parameters. Filtering stages add to counters of the worker they run on.
+ * Noise for filter_pair() may have been generated ahead of time, two values
+ * (even and odd line) per pixel of the span; otherwise it's generated
+ * on the fly. Warm-up and tail columns at the edges of the span, which
+ * don't make it to the output, are left out of the counters.
+ */
+struct span
+{
+    size_t frame_index;
+    size_t pair;
+    size_t x;
+    size_t width;
+    struct pair_stats *stats;
+    struct params const *params;
+    int32_t const *noise;
+    size_t skip_left;
+    size_t skip_right;
+};
+
+/**
+ * Random seeds used to be taken from rand(), which made every frame depend
+ * on the whole history of the process. Instead, each RNG_BLOCK pixels of each
+ * line have their own seed derived from the frame index, the row pair index
+ * and the position, so any frame (or any part of it) can be rendered alone
+ * and still look exactly the same.
+ * The result is never zero, because juice() would get stuck on it.
+ */
+static int pair_seed(struct span const *span, int stream, size_t x)
+{
+    uint32_t h = hash32(hash32((uint32_t) span->frame_index) ^ (uint32_t) ((uint64_t) span->frame_index >> 32));
+
+    h = hash32(h ^ (uint32_t) span->pair);
+    h = hash32(h ^ (uint32_t) ((x / RNG_BLOCK) * 8 + stream)) & 0x7fffffffu;
+
+    return h ? (int) h : 1;
+}
+
+/**
+ * Byte offsets of samples within a 4-byte macropixel of packed 4:2:2 formats.
+ */
+struct packed_layout
+{
+    int y0;
+    int y1;
+    int u;
+    int v;
+};
+
+static struct packed_layout const uyvy_layout = { 1, 3, 0, 2 };
+static struct packed_layout const yuy2_layout = { 0, 2, 1, 3 };
+
+/**
+ * Everything threads need to know about the frame being filtered.
+ * Frame is split into jobs: bands of row pairs, and for very wide
+ * frames each band is split into segments as well. A strip of a frame
+ * is filtered the same way, buffers hold only its row pairs then.
+ */
+struct frame_job
+{
+    size_t frame_index;
+    size_t first_pair;
+    size_t pairs;
+    struct params const *params;
+    struct params snapshot;
+
+    uint8_t const *src;
+    size_t src_pitch;
+    struct packed_layout const *src_layout;
+
+    uint8_t *dst;
+    size_t dst_pitch;
+    struct packed_layout const *dst_layout;
+
+    uint8_t *proxy;
+    size_t proxy_factor;
+    size_t proxy_width;
+    size_t proxy_height;
+    size_t proxy_pitch;
+
+    uint32_t *const *sweep_dst;
+    size_t sweep_count;
+
+    uint8_t const *mask;
+
+    uint8_t *halo;
+    size_t halo_pitch;
+
+    int32_t const *noise;
+
+    size_t band_pairs;
+    size_t segments;
+    size_t jobs;
+};
+
+/**
+ * Per-thread state. Worker 0 is the thread calling f0r_update() itself.
+ */
+struct worker
+{
+    struct secamiz0r *self;
+    uint8_t *scratch;
+    uint16_t *proxy_sums;
+    struct pair_stats stats;
+
+#ifdef SECAMIZ0R_THREADS
+    pthread_t thread;
+    unsigned int generation;
+#endif
+
+    // Workers sit next to each other in one array and update their
+    // statistics all the time, so the statistics of neighbours
+    // never share a cache line.
+    uint8_t padding[CACHE_LINE];
+};
+
+#ifdef SECAMIZ0R_THREADS
+/**
+ * Helper thread which generates noise of the next frame while the current
+ * one is being filtered. Of the two buffers, one may be read by the frame
+ * being filtered, and the other one is written by the helper.
+ */
+struct noise_ahead
+{
+    struct secamiz0r *self;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int32_t *values[2];
+    size_t frame_index[2];
+    int ready[2];
+    int in_use;
+    int writing;
+    size_t request;
+    int requested;
+    int quit;
+};
+#endif
+
+/**
+ * All stages for a row pair with RGBA source and destination, either
+ * specialized for a particular width or not.
+ */
+typedef void (*rgba_kernel)(struct secamiz0r *self, uint8_t *even, uint8_t *odd, uint8_t const *src_even, uint8_t const *src_odd, struct span const *span);
+
+static rgba_kernel choose_rgba_kernel(unsigned int width);
+
+/**
+ * What an output frame depends on: the source, both intensities, formats
+ * and the frame index, which noise and line shifts come from.
+ */
+struct cache_key
+{
+    uint64_t src_hash;
+    uint64_t mask_hash;
+    double fire_intensity;
+    double noise_intensity;
+    size_t frame_index;
+    int src_format;
+    int dst_format;
+};
+
+/**
+ * Output frame kept for scrubbing back and forth.
+ */
+struct cache_entry
+{
+    struct cache_key key;
+    uint64_t last_used;
+    size_t size;
+    uint8_t *data;
+};
+
+#ifdef SECAMIZ0R_TRACE
+/**
+ * Something that took some time on some thread: a frame, a band of row
+ * pairs (or a segment of it), or a stage of a row pair.
+ */
+struct trace_event
+{
+    char const *name;
+    uint64_t begin;
+    uint64_t end;
+    uint64_t frame;
+    uint32_t thread;
+    int32_t pair;
+    int32_t segment;
+};
+#endif
+
+/**
+ * secamiz0r instance struct.
+ */
+struct secamiz0r
+{
+    unsigned int width;
+    unsigned int height;
+    size_t frame_count;
+
+    // Intensities as last set, maybe by another thread while a frame
+    // is being filtered. Each frame works with its own snapshot of them.
+#ifdef SECAMIZ0R_THREADS
+    _Atomic double fire_intensity;
+    _Atomic double noise_intensity;
+#else
+    double fire_intensity;
+    double noise_intensity;
+#endif
+
+    rgba_kernel process_rgba_pair;
+
+    unsigned int thread_count;
+    size_t band_pairs;
+    size_t segment_width;
+    struct worker *workers;
+
+    void *proxy;
+    unsigned int proxy_factor;
+
+#ifdef SECAMIZ0R_THREADS
+    struct noise_ahead *noise_ahead;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    unsigned int generation;
+    unsigned int busy;
+    int quit;
+    atomic_size_t next_job;
+#endif
+
+    struct frame_job job;
+    size_t cursor;
+    double slice_latency;
+
+    struct params *sweep_params;
+    size_t sweep_capacity;
+
+    uint8_t *halo;
+    size_t halo_size;
+
+    struct cache_entry *cache;
+    size_t cache_count;
+    size_t cache_budget;
+    size_t cache_used;
+    uint64_t cache_clock;
+
+    // Frames per second of the time passed with the cache on, which
+    // gives the parity of the frame number.
+    double frame_rate;
+
+    struct pair_stats stats;
+    uint64_t frames;
+    double total_latency;
+    double latencies[STATS_LATENCIES];
+    char stats_text[128];
+
+#ifdef SECAMIZ0R_TRACE
+    struct trace_event *trace;
+    size_t trace_capacity;
+#ifdef SECAMIZ0R_THREADS
+    atomic_size_t trace_next;
+#else
+    size_t trace_next;
+#endif
+#endif
+};
+
+static int set_thread_count(struct secamiz0r *self, unsigned int thread_count);
+static void stop_workers(struct secamiz0r *self);
+static void stop_noise_ahead(struct secamiz0r *self);
+static void format_stats(struct secamiz0r *self);
+static void autotune(struct secamiz0r *self, int tune_threads);
+
+#ifdef SECAMIZ0R_TRACE
+/**
+ * Index of the worker running on this thread, for trace events.
+ */
+static _Thread_local uint32_t trace_thread;
+
+/**
+ * Monotonic time in nanoseconds.
+ */
+static uint64_t trace_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * Put an event into the ring buffer, overwriting the oldest one if full.
+ */
+static void trace_record(struct secamiz0r *self, char const *name, uint64_t begin, uint64_t end, size_t pair, size_t segment)
+{
+    if (!self->trace) {
+        return;
+    }
+
+#ifdef SECAMIZ0R_THREADS
+    size_t index = atomic_fetch_add(&self->trace_next, 1) % self->trace_capacity;
+#else
+    size_t index = self->trace_next++ % self->trace_capacity;
+#endif
+
+    struct trace_event *event = &self->trace[index];
+
+    event->name = name;
+    event->begin = begin;
+    event->end = end;
+    event->frame = self->job.frame_index;
+    event->thread = trace_thread;
+    event->pair = (int32_t) pair;
+    event->segment = (int32_t) segment;
+}
+
+#endif
+
+/**
+ * USDT probes for bpftrace, perf and friends. They are just NOPs until
+ * someone attaches to them, so they are built in whenever sys/sdt.h is
+ * available. Intensities are passed in thousandths.
+ *
+ *   secamiz0r:frame__start(width, height, frame_index, fire, noise)
+ *   secamiz0r:frame__end(width, height, frame_index, fire, noise)
+ *   secamiz0r:begin(frame_index, pair, segment)
+ *   secamiz0r:stage(name, frame_index, pair, segment)
+ *
+ * "begin" is fired when work on a frame, a band or a row pair starts,
+ * "stage" when it or one of its stages ends, -1 means "not applicable".
+ */
+#ifdef SECAMIZ0R_USDT
+#define PROBE_FRAME(self, probe) \
+    DTRACE_PROBE5(secamiz0r, probe, (self)->width, (self)->height, (self)->job.frame_index, \
+                  (int) ((self)->job.params->fire_intensity * 1000.0), \
+                  (int) ((self)->job.params->noise_intensity * 1000.0))
+#define PROBE_BEGIN(self, pair, segment) \
+    DTRACE_PROBE3(secamiz0r, begin, (self)->job.frame_index, (long) (pair), (long) (segment))
+#define PROBE_STAGE(self, name, pair, segment) \
+    DTRACE_PROBE4(secamiz0r, stage, name, (self)->job.frame_index, (long) (pair), (long) (segment))
+#else
+#define PROBE_FRAME(self, probe)
+#define PROBE_BEGIN(self, pair, segment)
+#define PROBE_STAGE(self, name, pair, segment)
+#endif
+
+/**
+ * TRACE_START() remembers current time, every following TRACE_STAGE()
+ * records an event lasting since the previous mark and moves the mark.
+ * Both fire corresponding probes as well.
+ */
+#ifdef SECAMIZ0R_TRACE
+#define TRACE_START(self, pair, segment) \
+    uint64_t trace_mark = trace_clock(); \
+    PROBE_BEGIN(self, pair, segment)
+#define TRACE_STAGE(self, name, pair, segment) \
+    do { \
+        uint64_t trace_now = trace_clock(); \
+        trace_record(self, name, trace_mark, trace_now, pair, segment); \
+        trace_mark = trace_now; \
+        PROBE_STAGE(self, name, pair, segment); \
+    } while (0)
+#else
+#define TRACE_START(self, pair, segment) PROBE_BEGIN(self, pair, segment)
+#define TRACE_STAGE(self, name, pair, segment) PROBE_STAGE(self, name, pair, segment)
+#endif
+
+/**
+ * Monotonic time in seconds, for latency statistics. Wall clock would
+ * jump whenever the system time is adjusted.
+ */
+static double stats_clock(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+
+    return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+#endif
+}
+
+/**
+ * Add counters of a worker to the total.
+ */
+static void add_stats(struct pair_stats *total, struct pair_stats const *stats)
+{
+    total->pixels += stats->pixels;
+    total->ignited += stats->ignited;
+    total->saturated += stats->saturated;
+}
+
+static int compare_doubles(void const *a, void const *b)
+{
+    double x = *(double const *) a;
+    double y = *(double const *) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Render statistics parameter. Only called when it's asked for,
+ * so sorting recent latencies here costs nothing per frame.
+ */
+static void format_stats(struct secamiz0r *self)
+{
+    struct pair_stats stats = self->stats;
+
+    for (unsigned int i = 0; i < self->thread_count; i++) {
+        add_stats(&stats, &self->workers[i].stats);
+    }
+
+    size_t const count = (self->frames < STATS_LATENCIES) ? (size_t) self->frames : STATS_LATENCIES;
+    double latencies[STATS_LATENCIES];
+    double p99 = 0.0;
+
+    if (count > 0) {
+        memcpy(latencies, self->latencies, count * sizeof(*latencies));
+        qsort(latencies, count, sizeof(*latencies), compare_doubles);
+        p99 = latencies[(count * 99) / 100];
+    }
+
+    double const mean = self->frames ? (self->total_latency / self->frames) : 0.0;
+    double const ignited = stats.pixels ? ((double) stats.ignited / stats.pixels) : 0.0;
+    double const saturated = stats.pixels ? ((double) stats.saturated / (stats.pixels * 2)) : 0.0;
+
+    snprintf(self->stats_text, sizeof(self->stats_text),
+             "frames=%llu mean_ms=%.3f p99_ms=%.3f ignited=%.4f saturated=%.4f",
+             (unsigned long long) self->frames, mean * 1e3, p99 * 1e3, ignited, saturated);
+}
+
 /**
  * Some values are dependent on "fire intensity" parameter.
  */
-static void set_fire_intensity(struct secamiz0r *self, double fire_intensity)
+static void set_fire_intensity(struct params *params, double fire_intensity)
 {
-    double const x = self->fire_intensity = fire_intensity;
+    double const x = params->fire_intensity = fire_intensity;
 
-    self->fire_threshold = 1024 - (int) (x * x * 256.0);
-    self->fire_seed = (int) (x * 1024.0);
+    params->fire_threshold = 1024 - (int) (x * x * 256.0);
+    params->fire_seed = (int) (x * 1024.0);
 }
 
 /**
 * Some values are dependent on "noise intensity" parameter.
 */
-static void set_noise_intensity(struct secamiz0r *self, double noise_intensity)
+static void set_noise_intensity(struct params *params, double noise_intensity)
 {
-    double const x = self->noise_intensity = noise_intensity;
+    double const x = params->noise_intensity = noise_intensity;
+
+    params->luma_noise = clamp_int((int) (x * x * 256.0), 16, 224);
+    params->chroma_noise = clamp_int((int) (x * 256.0), 32, 256);
+    params->echo_offset = clamp_int((int) (x * 8.0), 2, 16);
+}
 
-    self->luma_noise = clamp_int((int) (x * x * 256.0), 16, 224);
-    self->chroma_noise = clamp_int((int) (x * 256.0), 32, 256);
-    self->echo_offset = clamp_int((int) (x * 8.0), 2, 16);
+/**
+ * Take current values of parameters, all derived values are computed
+ * from the same ones. Setters only ever store a single double, so this
+ * needs no locks even if parameters are being set at the same time.
+ */
+static void take_params(struct secamiz0r *self, struct params *params)
+{
+#ifdef SECAMIZ0R_THREADS
+    set_fire_intensity(params, atomic_load(&self->fire_intensity));
+    set_noise_intensity(params, atomic_load(&self->noise_intensity));
+#else
+    set_fire_intensity(params, self->fire_intensity);
+    set_noise_intensity(params, self->noise_intensity);
+#endif
 }
 
 /**
@@ -170,15 +735,21 @@ void f0r_deinit()
  */
 void f0r_get_plugin_info(f0r_plugin_info_t *info)
 {
+#ifdef SECAMIZ0R_MASK
+    info->name = "secamiz0r mask";
+    info->plugin_type = F0R_PLUGIN_TYPE_MIXER2;
+    info->explanation = "SECAM Fire effect, only where the second input is bright";
+#else
     info->name = "secamiz0r";
-    info->author = "tuorqai";
     info->plugin_type = F0R_PLUGIN_TYPE_FILTER;
+    info->explanation = "SECAM Fire effect";
+#endif
+    info->author = "tuorqai";
     info->color_model = F0R_COLOR_MODEL_RGBA8888;
     info->frei0r_version = FREI0R_MAJOR_VERSION;
     info->major_version = 2;
     info->minor_version = 0;
-    info->num_params = 2;
-    info->explanation = "SECAM Fire effect";
+    info->num_params = 3;
 }
 
 /**
@@ -198,6 +769,12 @@ void f0r_get_param_info(f0r_param_info_t *info, int index)
         info->explanation = NULL;
         info->type = F0R_PARAM_DOUBLE;
         break;
+    case 2:
+        info->name = "Statistics";
+        info->explanation = "Read-only: frames filtered, mean and p99 latency, "
+                            "fractions of ignited pixels and saturated samples";
+        info->type = F0R_PARAM_STRING;
+        break;
     default:
         break;
     }
@@ -218,8 +795,96 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
     self->height = height;
     self->frame_count = 0;
 
-    set_fire_intensity(self, 0.125);
-    set_noise_intensity(self, 0.125);
+#ifdef SECAMIZ0R_THREADS
+    atomic_init(&self->fire_intensity, 0.125);
+    atomic_init(&self->noise_intensity, 0.125);
+#else
+    self->fire_intensity = 0.125;
+    self->noise_intensity = 0.125;
+#endif
+
+    take_params(self, &self->job.snapshot);
+    self->job.params = &self->job.snapshot;
+
+    self->process_rgba_pair = choose_rgba_kernel(width);
+
+    self->thread_count = 0;
+    self->band_pairs = BAND_PAIRS;
+    self->segment_width = SEGMENT_WIDTH;
+    self->workers = NULL;
+
+    self->proxy = NULL;
+    self->proxy_factor = 0;
+
+#ifdef SECAMIZ0R_THREADS
+    self->noise_ahead = NULL;
+#endif
+
+    self->sweep_params = NULL;
+    self->sweep_capacity = 0;
+
+    self->halo = NULL;
+    self->halo_size = 0;
+
+    self->cache = NULL;
+    self->cache_count = 0;
+    self->cache_budget = 0;
+    self->cache_used = 0;
+    self->cache_clock = 0;
+    self->frame_rate = 25.0;
+
+    self->cursor = height / 2;
+    self->slice_latency = 0.0;
+
+    memset(&self->stats, 0, sizeof(self->stats));
+    self->frames = 0;
+    self->total_latency = 0.0;
+    self->stats_text[0] = '\0';
+
+#ifdef SECAMIZ0R_THREADS
+    pthread_mutex_init(&self->mutex, NULL);
+    pthread_cond_init(&self->start_cond, NULL);
+    pthread_cond_init(&self->done_cond, NULL);
+    self->generation = 0;
+    self->busy = 0;
+    self->quit = 0;
+#endif
+
+#ifdef SECAMIZ0R_TRACE
+    char const *trace_events = getenv("SECAMIZ0R_TRACE_EVENTS");
+
+    self->trace_capacity = trace_events ? (size_t) strtoul(trace_events, NULL, 10) : TRACE_CAPACITY;
+    self->trace = self->trace_capacity ? calloc(self->trace_capacity, sizeof(*self->trace)) : NULL;
+    self->trace_next = 0;
+    self->job.frame_index = 0;
+#endif
+
+    char const *threads = getenv("SECAMIZ0R_NUM_THREADS");
+
+    if (!set_thread_count(self, threads ? (unsigned int) atoi(threads) : 1)) {
+        f0r_destruct(self);
+        return NULL;
+    }
+
+    // Tuning takes a few dozen frames and writes a file, hosts don't
+    // expect that from a plugin unless they ask for it.
+    char const *tune = getenv("SECAMIZ0R_AUTOTUNE");
+
+    if (tune && atoi(tune) != 0) {
+        autotune(self, !threads);
+    }
+
+    char const *cache = getenv("SECAMIZ0R_CACHE_MB");
+
+    if (cache) {
+        secamiz0r_set_cache(self, (size_t) strtoul(cache, NULL, 10) << 20);
+    }
+
+    char const *noise_ahead = getenv("SECAMIZ0R_NOISE_AHEAD");
+
+    if (noise_ahead && atoi(noise_ahead) != 0) {
+        secamiz0r_set_noise_ahead(self, 1);
+    }
 
     return self;
 }
@@ -229,11 +894,39 @@ f0r_instance_t f0r_construct(unsigned int width, unsigned int height)
  */
 void f0r_destruct(f0r_instance_t instance)
 {
-    free(instance);
+    struct secamiz0r *self = instance;
+
+#ifdef SECAMIZ0R_TRACE
+    char const *trace_file = getenv("SECAMIZ0R_TRACE_FILE");
+
+    if (trace_file) {
+        secamiz0r_write_trace(self, trace_file);
+    }
+#endif
+
+    stop_noise_ahead(self);
+    stop_workers(self);
+    free(self->sweep_params);
+    free(self->halo);
+    secamiz0r_set_cache(self, 0);
+
+#ifdef SECAMIZ0R_TRACE
+    free(self->trace);
+#endif
+
+#ifdef SECAMIZ0R_THREADS
+    pthread_cond_destroy(&self->done_cond);
+    pthread_cond_destroy(&self->start_cond);
+    pthread_mutex_destroy(&self->mutex);
+#endif
+
+    free(self);
 }
 
 /**
- * Parameter value setter.
+ * Parameter value setter. Unlike the rest of the plugin, it is safe to call
+ * from another thread while a frame is being filtered: the new value is
+ * picked up by the next frame.
  */
 void f0r_set_param_value(f0r_instance_t instance, f0r_param_t param, int index)
 {
@@ -241,10 +934,18 @@ void f0r_set_param_value(f0r_instance_t instance, f0r_param_t param, int index)
 
     switch (index) {
     case 0:
-        set_fire_intensity(self, *((double const *) param));
+#ifdef SECAMIZ0R_THREADS
+        atomic_store(&self->fire_intensity, *((double const *) param));
+#else
+        self->fire_intensity = *((double const *) param);
+#endif
         break;
     case 1:
-        set_noise_intensity(self, *((double const *) param));
+#ifdef SECAMIZ0R_THREADS
+        atomic_store(&self->noise_intensity, *((double const *) param));
+#else
+        self->noise_intensity = *((double const *) param);
+#endif
         break;
     default:
         break;
@@ -260,10 +961,22 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int index)
 
     switch (index) {
     case 0:
+#ifdef SECAMIZ0R_THREADS
+        *((double *) param) = atomic_load(&self->fire_intensity);
+#else
         *((double *) param) = self->fire_intensity;
+#endif
         break;
     case 1:
+#ifdef SECAMIZ0R_THREADS
+        *((double *) param) = atomic_load(&self->noise_intensity);
+#else
         *((double *) param) = self->noise_intensity;
+#endif
+        break;
+    case 2:
+        format_stats(self);
+        *((f0r_param_string *) param) = self->stats_text;
         break;
     default:
         break;
@@ -277,19 +990,26 @@ void f0r_get_param_value(f0r_instance_t instance, f0r_param_t param, int index)
  * exception of secamiz0r struct in f0r_construct()). So the only available storage for us
  * is the destination buffer provided by frei0r itself.
  */
-static void copy_pair_as_yuv(struct secamiz0r *self, uint8_t *dst_even, uint8_t *dst_odd, uint8_t const *src_even, uint8_t const *src_odd)
+static ALWAYS_INLINE void copy_pair_as_yuv(struct secamiz0r *self, uint8_t *dst_even, uint8_t *dst_odd, uint8_t const *src_even, uint8_t const *src_odd, size_t width)
 {
-    for (size_t i = 0; i < self->width; i += 2) {
+    for (size_t i = 0; i < width; i += 2) {
         float rgb0_even[3];
         float rgb1_even[3];
         float rgb0_odd[3];
         float rgb1_odd[3];
 
+        // Everything is read before anything is written, so that
+        // source and destination may be the same rows.
         unpack_rgb(rgb0_even, &src_even[(i + 0) * 4]);
         unpack_rgb(rgb1_even, &src_even[(i + 1) * 4]);
         unpack_rgb(rgb0_odd, &src_odd[(i + 0) * 4]);
         unpack_rgb(rgb1_odd, &src_odd[(i + 1) * 4]);
 
+        uint8_t const a0_even = src_even[(i + 0) * 4 + 3];
+        uint8_t const a1_even = src_even[(i + 1) * 4 + 3];
+        uint8_t const a0_odd = src_odd[(i + 0) * 4 + 3];
+        uint8_t const a1_odd = src_odd[(i + 1) * 4 + 3];
+
         float rgb_even[] = {
             (rgb0_even[0] + rgb1_even[0]) / 2.f,
             (rgb0_even[1] + rgb1_even[1]) / 2.f,
@@ -312,44 +1032,78 @@ static void copy_pair_as_yuv(struct secamiz0r *self, uint8_t *dst_even, uint8_t
         dst_even[(i + 0) * 4 + 0] = y0_even;
         dst_even[(i + 0) * 4 + 1] = v;
         dst_even[(i + 0) * 4 + 2] = 0;
-        dst_even[(i + 0) * 4 + 3] = src_even[(i + 0) * 4 + 3];
+        dst_even[(i + 0) * 4 + 3] = a0_even;
 
         dst_even[(i + 1) * 4 + 0] = y1_even;
         dst_even[(i + 1) * 4 + 1] = v;
         dst_even[(i + 1) * 4 + 2] = 0;
-        dst_even[(i + 1) * 4 + 3] = src_even[(i + 1) * 4 + 3];
+        dst_even[(i + 1) * 4 + 3] = a1_even;
 
         dst_odd[(i + 0) * 4 + 0] = y0_odd;
         dst_odd[(i + 0) * 4 + 1] = u;
         dst_odd[(i + 0) * 4 + 2] = 0;
-        dst_odd[(i + 0) * 4 + 3] = src_odd[(i + 0) * 4 + 3];
+        dst_odd[(i + 0) * 4 + 3] = a0_odd;
 
         dst_odd[(i + 1) * 4 + 0] = y1_odd;
         dst_odd[(i + 1) * 4 + 1] = u;
         dst_odd[(i + 1) * 4 + 2] = 0;
-        dst_odd[(i + 1) * 4 + 3] = src_odd[(i + 1) * 4 + 3];
+        dst_odd[(i + 1) * 4 + 3] = a1_odd;
+    }
+}
+
+/**
+ * Filtering Stage 1, packed 4:2:2 variant. Source is already YUV, so luma is
+ * copied as is, and chroma goes straight to the place where copy_pair_as_yuv()
+ * puts it: R-Y into the even line, B-Y into the odd one. Other half of the
+ * chroma samples is not needed by the filter.
+ */
+static void copy_pair_from_packed(struct secamiz0r *self, uint8_t *dst_even, uint8_t *dst_odd, uint8_t const *src_even, uint8_t const *src_odd, size_t width, struct packed_layout const *layout)
+{
+    for (size_t i = 0; i < width; i += 2) {
+        uint8_t const *even = &src_even[i * 2];
+        uint8_t const *odd = &src_odd[i * 2];
+
+        dst_even[(i + 0) * 4 + 0] = even[layout->y0];
+        dst_even[(i + 0) * 4 + 1] = even[layout->v];
+        dst_even[(i + 0) * 4 + 2] = 0;
+        dst_even[(i + 0) * 4 + 3] = 255;
+
+        dst_even[(i + 1) * 4 + 0] = even[layout->y1];
+        dst_even[(i + 1) * 4 + 1] = even[layout->v];
+        dst_even[(i + 1) * 4 + 2] = 0;
+        dst_even[(i + 1) * 4 + 3] = 255;
+
+        dst_odd[(i + 0) * 4 + 0] = odd[layout->y0];
+        dst_odd[(i + 0) * 4 + 1] = odd[layout->u];
+        dst_odd[(i + 0) * 4 + 2] = 0;
+        dst_odd[(i + 0) * 4 + 3] = 255;
+
+        dst_odd[(i + 1) * 4 + 0] = odd[layout->y1];
+        dst_odd[(i + 1) * 4 + 1] = odd[layout->u];
+        dst_odd[(i + 1) * 4 + 2] = 0;
+        dst_odd[(i + 1) * 4 + 3] = 255;
     }
 }
 
 /**
  * Moves line back and forth.
  */
-static void shift_line(struct secamiz0r *self, uint8_t *line, int shift)
+static ALWAYS_INLINE void shift_line(struct secamiz0r *self, uint8_t *line, size_t width, int shift)
 {
     if (shift < 0) {
         int nshift = -shift;
 
-        for (size_t i = 0; i < self->width - nshift; i++) {
+        for (size_t i = 0; i < width - nshift; i++) {
             // memcpy(&line[i * 4], &line[(i * 4) + (nshift * 4)], 4);
             line[i * 4 + 0] = line[(i * 4) + (nshift * 4) + 0];
         }
 
-        for (size_t i = self->width - nshift; i < self->width; i++) {
+        for (size_t i = width - nshift; i < width; i++) {
             line[i * 4 + 0] = 0;
             line[i * 4 + 1] = 128;
         }
     } else if (shift > 0) {
-        for (size_t i = self->width - 1; i >= shift; i--) {
+        for (size_t i = width - 1; i >= shift; i--) {
             // memcpy(&line[i * 4], &line[(i * 4) - (shift * 4)], 4);
             line[i * 4 + 0] = line[(i * 4) - (shift * 4) + 0];
         }
@@ -372,15 +1126,34 @@ static void shift_line(struct secamiz0r *self, uint8_t *line, int shift)
  * (Addition: also take the blue-ish or cyan-ish areas into the account).
  * (Addition: shift lines a few pixels to the side to simulate bad sync).
  */
-static void prefilter_pair(struct secamiz0r *self, uint8_t *even, uint8_t *odd)
+static ALWAYS_INLINE void prefilter_pair(struct secamiz0r *self, uint8_t *even, uint8_t *odd, struct span const *span)
 {
-    int r_even = rand();
-    int r_odd = rand();
+    struct params const *params = span->params;
+
+    int r_even = pair_seed(span, 0, span->x);
+    int r_odd = pair_seed(span, 1, span->x);
+
+    int y_even_oscillation = (params->fire_seed && span->x == 0) ? umod(r_even, params->fire_seed) : 0;
+    int y_odd_oscillation = (params->fire_seed && span->x == 0) ? umod(r_odd, params->fire_seed) : 0;
+
+    uint64_t ignited = 0;
+
+    size_t const counted_x0 = span->skip_left;
+    size_t const counted_x1 = span->width - span->skip_right;
+
+    // The loop starts from the second pixel, in the middle of a line
+    // the generator should be one step further from the seed by then.
+    if (span->x > 0) {
+        r_even = juice(r_even);
+        r_odd = juice(r_odd);
+    }
 
-    int y_even_oscillation = self->fire_seed ? umod(r_even, self->fire_seed) : 0;
-    int y_odd_oscillation = self->fire_seed ? umod(r_odd, self->fire_seed) : 0;
+    for (size_t i = 1; i < span->width; i++) {
+        if ((span->x + i) % RNG_BLOCK == 0) {
+            r_even = pair_seed(span, 0, span->x + i);
+            r_odd = pair_seed(span, 1, span->x + i);
+        }
 
-    for (size_t i = 1; i < self->width; i++) {
         int even_luma_delta = even[i * 4 + 0] - even[i * 4 - 4];
         int odd_luma_delta = odd[i * 4 + 0] - odd[i * 4 - 4];
 
@@ -390,12 +1163,16 @@ static void prefilter_pair(struct secamiz0r *self, uint8_t *even, uint8_t *odd)
         y_even_oscillation += abs(even_luma_delta - odd_chroma_delta - umod(r_even, 512));
         y_odd_oscillation += abs(odd_luma_delta - even_chroma_delta - umod(r_odd, 512));
 
-        if (y_even_oscillation > self->fire_threshold) {
+        int const counted = (i >= counted_x0 && i < counted_x1);
+
+        if (y_even_oscillation > params->fire_threshold) {
             even[i * 4 + 2] = umod(r_even, 80);
+            ignited += counted;
         }
 
-        if (y_odd_oscillation > self->fire_threshold) {
+        if (y_odd_oscillation > params->fire_threshold) {
             odd[i * 4 + 2] = umod(r_odd, 80);
+            ignited += counted;
         }
 
         r_even = juice(r_even);
@@ -405,23 +1182,31 @@ static void prefilter_pair(struct secamiz0r *self, uint8_t *even, uint8_t *odd)
         y_odd_oscillation /= 2;
     }
 
+    span->stats->pixels += (counted_x1 - counted_x0) * 2;
+    span->stats->ignited += ignited;
+
     // Addition: simulate bad deinterlace and bad sync.
+    // Seeds are never negative, one step of the generator makes them
+    // signed, so lines are shifted either way (-3 to 3 pixels).
 
-    int even_extra_shift = (self->luma_noise > 80) ? (r_even % 4) : 0;
-    int odd_extra_shift = (self->luma_noise > 80) ? (r_odd % 4) : 0;
+    int even_extra_shift = (params->luma_noise > 80) ? (juice(pair_seed(span, 4, 0)) % 4) : 0;
+    int odd_extra_shift = (params->luma_noise > 80) ? (juice(pair_seed(span, 5, 0)) % 4) : 0;
 
-    shift_line(self, even, (self->frame_count % 2) + even_extra_shift);
-    shift_line(self, odd, !(self->frame_count % 2) + odd_extra_shift);
+    shift_line(self, even, span->width, (span->frame_index % 2) + even_extra_shift);
+    shift_line(self, odd, span->width, !(span->frame_index % 2) + odd_extra_shift);
 }
 
 /**
  * Filtering Stage 2.2. This actually modifies the image, adding random noise
  * and fires at marked areas.
  */
-static void filter_pair(struct secamiz0r *self, uint8_t *even, uint8_t *odd)
+static ALWAYS_INLINE void filter_pair(struct secamiz0r *self, uint8_t *even, uint8_t *odd, struct span const *span)
 {
-    int r_even = rand();
-    int r_odd = rand();
+    struct params const *params = span->params;
+    int32_t const *noise = span->noise;
+
+    int r_even = 0;
+    int r_odd = 0;
 
     int u_fire = 0;
     int u_fire_sign = 1;
@@ -431,7 +1216,20 @@ static void filter_pair(struct secamiz0r *self, uint8_t *even, uint8_t *odd)
 
     int const fire_fade = 1;
 
-    for (size_t i = 0; i < self->width; i++) {
+    uint64_t saturated = 0;
+
+    size_t const counted_x0 = span->skip_left;
+    size_t const counted_x1 = span->width - span->skip_right;
+
+    for (size_t i = 0; i < span->width; i++) {
+        if (noise) {
+            r_even = noise[i * 2 + 0];
+            r_odd = noise[i * 2 + 1];
+        } else if ((span->x + i) % RNG_BLOCK == 0 || i == 0) {
+            r_even = pair_seed(span, 2, span->x + i);
+            r_odd = pair_seed(span, 3, span->x + i);
+        }
+
         int y_even = even[i * 4 + 0];
         int y_odd = odd[i * 4 + 0];
 
@@ -465,19 +1263,24 @@ static void filter_pair(struct secamiz0r *self, uint8_t *even, uint8_t *odd)
             v_fire = z_even;
         }
 
-        if (self->luma_noise > 0) {
-            y_even += r_even % self->luma_noise;
-            y_odd += r_odd % self->luma_noise;
+        if (params->luma_noise > 0) {
+            y_even += r_even % params->luma_noise;
+            y_odd += r_odd % params->luma_noise;
+        }
+
+        if (params->chroma_noise > 0) {
+            u += (int) (u * 2.f * (params->chroma_noise / 256.f)) + (r_odd % params->chroma_noise);
+            v += (int) (v * 2.f * (params->chroma_noise / 256.f)) + (r_even % params->chroma_noise);
         }
 
-        if (self->chroma_noise > 0) {
-            u += (int) (u * 2.f * (self->chroma_noise / 256.f)) + (r_odd % self->chroma_noise);
-            v += (int) (v * 2.f * (self->chroma_noise / 256.f)) + (r_even % self->chroma_noise);
+        if (params->echo_offset >= 1 && i >= params->echo_offset) {
+            y_even += (y_even - even[(i - params->echo_offset) * 4]) / 2;
+            y_odd += (y_odd - odd[(i - params->echo_offset) * 4]) / 2;
         }
 
-        if (self->echo_offset >= 1 && i >= self->echo_offset) {
-            y_even += (y_even - even[(i - self->echo_offset) * 4]) / 2;
-            y_odd += (y_odd - odd[(i - self->echo_offset) * 4]) / 2;
+        if (i >= counted_x0 && i < counted_x1) {
+            saturated += ((unsigned int) y_even > 255u) + ((unsigned int) (v + 128) > 255u)
+                + ((unsigned int) y_odd > 255u) + ((unsigned int) (u + 128) > 255u);
         }
 
         even[i * 4 + 0] = clamp_byte(y_even);
@@ -486,9 +1289,13 @@ static void filter_pair(struct secamiz0r *self, uint8_t *even, uint8_t *odd)
         odd[i * 4 + 0] = clamp_byte(y_odd);
         odd[i * 4 + 1] = clamp_byte(u + 128);
 
-        r_even = juice(r_even);
-        r_odd = juice(r_odd);
+        if (!noise) {
+            r_even = juice(r_even);
+            r_odd = juice(r_odd);
+        }
     }
+
+    span->stats->saturated += saturated;
 }
 
 /**
@@ -496,25 +1303,25 @@ static void filter_pair(struct secamiz0r *self, uint8_t *even, uint8_t *odd)
  * now converted to RGB in place. But conversion isn't straightforward: to make
  * the image look more analog, a sophisticated method is used.
  */
-static void convert_pair_to_rgb(struct secamiz0r *self, uint8_t *even, uint8_t *odd)
+static ALWAYS_INLINE void convert_pair_to_rgb(struct secamiz0r *self, uint8_t *even, uint8_t *odd, size_t width)
 {
     int const luma_loss = 4;
     int const chroma_loss = 8;
     
-    for (size_t i = 0; i < self->width; i++) {
+    for (size_t i = 0; i < width; i++) {
         float y_even = 0.f;
         float y_odd = 0.f;
         float u = 0.f;
         float v = 0.f;
 
         for (int j = 0; j < luma_loss; j++) {
-            size_t idx = (size_t) clamp_int((int) (i + j), 0, (int) self->width - 1);
+            size_t idx = (size_t) clamp_int((int) (i + j), 0, (int) width - 1);
             y_even += (float) even[4 * idx + 0];
             y_odd += (float) odd[4 * idx + 0];
         }
 
         for (int j = 0; j < chroma_loss; j++) {
-            size_t idx = (size_t) clamp_int((int) (i + j), 0, (int) self->width - 1);
+            size_t idx = (size_t) clamp_int((int) (i + j), 0, (int) width - 1);
             u += (float) odd[4 * idx + 1];
             v += (float) even[4 * idx + 1];
         }
@@ -530,28 +1337,1992 @@ static void convert_pair_to_rgb(struct secamiz0r *self, uint8_t *even, uint8_t *
 }
 
 /**
- * The whole process of filtering is done here.
- * This function is called every frame.
+ * Average of a few consecutive samples of one channel, starting at i.
  */
-void f0r_update(f0r_instance_t instance, double time, uint32_t const* src, uint32_t *dst)
+static uint8_t blur_sample(struct secamiz0r *self, uint8_t const *line, size_t width, size_t i, int channel, int loss)
 {
-    struct secamiz0r *self = instance;
+    int sum = 0;
+
+    for (int j = 0; j < loss; j++) {
+        size_t idx = (size_t) clamp_int((int) (i + j), 0, (int) width - 1);
+        sum += line[4 * idx + channel];
+    }
+
+    return (uint8_t) (sum / loss);
+}
 
-    for (size_t i = 0; i < self->height; i += 2) {
-        size_t even = (i + 0) * self->width;
-        size_t odd = (i + 1) * self->width;
+/**
+ * Filtering Stage 3, packed 4:2:2 variant. Same analog-ish blur as in
+ * convert_pair_to_rgb(), but the result stays in YUV, so it is written
+ * to the separate destination rows. Both lines share the same chroma.
+ */
+static void convert_pair_to_packed(struct secamiz0r *self, uint8_t *dst_even, uint8_t *dst_odd, uint8_t const *even, uint8_t const *odd, size_t width, struct packed_layout const *layout)
+{
+    int const luma_loss = 4;
+    int const chroma_loss = 8;
 
-        uint8_t const *src_even = (uint8_t const *) &src[even];
-        uint8_t const *src_odd = (uint8_t const *) &src[odd];
+    for (size_t i = 0; i < width; i += 2) {
+        uint8_t u = blur_sample(self, odd, width, i, 1, chroma_loss);
+        uint8_t v = blur_sample(self, even, width, i, 1, chroma_loss);
 
-        uint8_t *dst_even = (uint8_t *) &dst[even];
-        uint8_t *dst_odd = (uint8_t *) &dst[odd];
+        dst_even[i * 2 + layout->y0] = blur_sample(self, even, width, i + 0, 0, luma_loss);
+        dst_even[i * 2 + layout->y1] = blur_sample(self, even, width, i + 1, 0, luma_loss);
+        dst_even[i * 2 + layout->u] = u;
+        dst_even[i * 2 + layout->v] = v;
 
-        copy_pair_as_yuv(self, dst_even, dst_odd, src_even, src_odd);
-        prefilter_pair(self, dst_even, dst_odd);
-        filter_pair(self, dst_even, dst_odd);
-        convert_pair_to_rgb(self, dst_even, dst_odd);
+        dst_odd[i * 2 + layout->y0] = blur_sample(self, odd, width, i + 0, 0, luma_loss);
+        dst_odd[i * 2 + layout->y1] = blur_sample(self, odd, width, i + 1, 0, luma_loss);
+        dst_odd[i * 2 + layout->u] = u;
+        dst_odd[i * 2 + layout->v] = v;
     }
+}
 
-    self->frame_count++;
+/**
+ * Packed 4:2:2 layout of the format, NULL for RGBA.
+ */
+static struct packed_layout const *get_packed_layout(enum secamiz0r_format format)
+{
+    switch (format) {
+    case SECAMIZ0R_FORMAT_UYVY:
+        return &uyvy_layout;
+    case SECAMIZ0R_FORMAT_YUY2:
+        return &yuy2_layout;
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * Extended API: frame size in bytes.
+ */
+size_t secamiz0r_frame_size(unsigned int width, unsigned int height, enum secamiz0r_format format)
+{
+    size_t const pixel_size = get_packed_layout(format) ? 2 : 4;
+
+    return (size_t) width * height * pixel_size;
+}
+
+/**
+ * Stages 1 to 3 for the most common case: RGBA in, RGBA out.
+ * Width is passed on its own, so that it's a constant in kernels
+ * specialized for it.
+ */
+static ALWAYS_INLINE void process_rgba_pair(struct secamiz0r *self, uint8_t *even, uint8_t *odd, uint8_t const *src_even, uint8_t const *src_odd, struct span const *whole, size_t width)
+{
+    struct span const span = {
+        .frame_index = whole->frame_index, .pair = whole->pair, .x = 0, .width = width,
+        .stats = whole->stats, .params = whole->params, .noise = whole->noise,
+        .skip_left = 0, .skip_right = 0,
+    };
+
+    TRACE_START(self, span.pair, 0);
+    copy_pair_as_yuv(self, even, odd, src_even, src_odd, width);
+    TRACE_STAGE(self, "copy_pair_as_yuv", span.pair, 0);
+    prefilter_pair(self, even, odd, &span);
+    TRACE_STAGE(self, "prefilter_pair", span.pair, 0);
+    filter_pair(self, even, odd, &span);
+    TRACE_STAGE(self, "filter_pair", span.pair, 0);
+    convert_pair_to_rgb(self, even, odd, width);
+    TRACE_STAGE(self, "convert_pair_to_rgb", span.pair, 0);
+}
+
+/**
+ * Instantiate process_rgba_pair() for a fixed width.
+ */
+#define DEFINE_RGBA_KERNEL(name, width) \
+    static void name(struct secamiz0r *self, uint8_t *even, uint8_t *odd, uint8_t const *src_even, uint8_t const *src_odd, struct span const *span) \
+    { \
+        process_rgba_pair(self, even, odd, src_even, src_odd, span, width); \
+    }
+
+DEFINE_RGBA_KERNEL(process_rgba_pair_any, self->width)
+DEFINE_RGBA_KERNEL(process_rgba_pair_720, 720)
+DEFINE_RGBA_KERNEL(process_rgba_pair_1280, 1280)
+DEFINE_RGBA_KERNEL(process_rgba_pair_1920, 1920)
+DEFINE_RGBA_KERNEL(process_rgba_pair_3840, 3840)
+
+/**
+ * Broadcast widths get their own kernels, everything else goes through
+ * the generic one.
+ */
+static rgba_kernel choose_rgba_kernel(unsigned int width)
+{
+    switch (width) {
+    case 720:
+        return process_rgba_pair_720;
+    case 1280:
+        return process_rgba_pair_1280;
+    case 1920:
+        return process_rgba_pair_1920;
+    case 3840:
+        return process_rgba_pair_3840;
+    default:
+        return process_rgba_pair_any;
+    }
+}
+
+/**
+ * Offset of the luma sample of pixel x within a packed 4:2:2 row.
+ */
+static size_t packed_luma_offset(struct packed_layout const *layout, size_t x)
+{
+    return (x / 2) * 4 + (size_t) ((x & 1) ? layout->y1 : layout->y0);
+}
+
+/**
+ * Add columns x0 to x1 of a freshly filtered row pair of the destination
+ * to the proxy, while the rows are still in cache. A proxy row takes
+ * factor / 2 row pairs, always from the same band, so sums are kept by
+ * the worker and written out after the last of them. Each sample of the
+ * proxy is the average of factor x factor samples of the same kind:
+ * channels of RGBA pixels, or luma samples and chroma pairs of packed
+ * formats.
+ */
+static void add_pair_to_proxy(struct worker *worker, struct frame_job const *job, size_t pair, size_t x0, size_t x1)
+{
+    if (!job->proxy) {
+        return;
+    }
+
+    size_t const factor = job->proxy_factor;
+    size_t const row = (pair * 2) / factor;
+
+    if (row >= job->proxy_height) {
+        return;
+    }
+
+    struct packed_layout const *layout = job->dst_layout;
+    size_t const pixel_size = layout ? 2 : 4;
+    size_t const p0 = x0 / factor;
+    size_t const p1 = (x1 / factor < job->proxy_width) ? (x1 / factor) : job->proxy_width;
+
+    uint8_t const *even = &job->dst[(pair * 2 + 0) * job->dst_pitch];
+    uint8_t const *odd = &job->dst[(pair * 2 + 1) * job->dst_pitch];
+    uint16_t *sums = worker->proxy_sums;
+
+    if ((pair * 2) % factor == 0) {
+        memset(&sums[p0 * pixel_size], 0, (p1 - p0) * pixel_size * sizeof(*sums));
+    }
+
+    if (!layout) {
+        for (size_t p = p0; p < p1; p++) {
+            for (size_t x = p * factor; x < (p + 1) * factor; x++) {
+                for (int c = 0; c < 4; c++) {
+                    sums[p * 4 + c] += even[x * 4 + c] + odd[x * 4 + c];
+                }
+            }
+        }
+    } else {
+        for (size_t p = p0; p < p1; p++) {
+            size_t const luma = packed_luma_offset(layout, p);
+
+            for (size_t x = p * factor; x < (p + 1) * factor; x++) {
+                size_t const offset = packed_luma_offset(layout, x);
+                sums[luma] += even[offset] + odd[offset];
+            }
+
+            // Chroma pair of the proxy covers as many source pairs as
+            // a proxy pixel covers source pixels.
+            if (p & 1) {
+                continue;
+            }
+
+            for (size_t m = (p / 2) * factor; m < (p / 2 + 1) * factor; m++) {
+                sums[(p / 2) * 4 + layout->u] += even[m * 4 + layout->u] + odd[m * 4 + layout->u];
+                sums[(p / 2) * 4 + layout->v] += even[m * 4 + layout->v] + odd[m * 4 + layout->v];
+            }
+        }
+    }
+
+    if ((pair * 2 + 2) % factor != 0) {
+        return;
+    }
+
+    uint8_t *proxy = &job->proxy[row * job->proxy_pitch];
+    unsigned int const area = (unsigned int) (factor * factor);
+
+    for (size_t i = p0 * pixel_size; i < p1 * pixel_size; i++) {
+        proxy[i] = (uint8_t) ((sums[i] + area / 2) / area);
+    }
+}
+
+/**
+ * Noise generated ahead for a span of a row pair, if there is any and
+ * the span starts where the generator is reseeded anyway.
+ */
+static int32_t const *get_span_noise(struct secamiz0r const *self, struct frame_job const *job, size_t pair, size_t x)
+{
+    if (!job->noise || x % RNG_BLOCK != 0) {
+        return NULL;
+    }
+
+    return &job->noise[(pair * self->width + x) * 2];
+}
+
+/**
+ * Filter one row pair with every set of parameters of a sweep, RGBA only.
+ * The source is converted to YUV once, into the first output, and copied
+ * from there to the others before they are filtered. The first output
+ * is filtered last.
+ */
+static void process_sweep(struct worker *worker, struct frame_job const *job, size_t pair)
+{
+    struct secamiz0r *self = worker->self;
+    size_t const row_size = (size_t) self->width * 4;
+
+    uint8_t const *src_even = &job->src[(pair * 2 + 0) * job->src_pitch];
+    uint8_t const *src_odd = &job->src[(pair * 2 + 1) * job->src_pitch];
+
+    uint8_t *yuv_even = &job->dst[(pair * 2 + 0) * job->dst_pitch];
+    uint8_t *yuv_odd = &job->dst[(pair * 2 + 1) * job->dst_pitch];
+
+    TRACE_START(self, pair, 0);
+    copy_pair_as_yuv(self, yuv_even, yuv_odd, src_even, src_odd, self->width);
+    TRACE_STAGE(self, "copy_pair_as_yuv", pair, 0);
+
+    for (size_t i = job->sweep_count; i-- > 0;) {
+        struct span const span = {
+            .frame_index = job->frame_index, .pair = job->first_pair + pair, .x = 0, .width = self->width,
+            .stats = &worker->stats, .params = &job->params[i], .noise = get_span_noise(self, job, pair, 0),
+            .skip_left = 0, .skip_right = 0,
+        };
+
+        uint8_t *even = &((uint8_t *) job->sweep_dst[i])[(pair * 2 + 0) * job->dst_pitch];
+        uint8_t *odd = &((uint8_t *) job->sweep_dst[i])[(pair * 2 + 1) * job->dst_pitch];
+
+        if (i > 0) {
+            memcpy(even, yuv_even, row_size);
+            memcpy(odd, yuv_odd, row_size);
+        }
+
+        prefilter_pair(self, even, odd, &span);
+        filter_pair(self, even, odd, &span);
+        convert_pair_to_rgb(self, even, odd, self->width);
+        TRACE_STAGE(self, "sweep_set", pair, 0);
+    }
+}
+
+/**
+ * Weight of a mask pixel: its luma, from 0 (outside) to 255 (inside).
+ */
+static unsigned int mask_weight(uint8_t const *pixel)
+{
+    return (pixel[0] * 77u + pixel[1] * 150u + pixel[2] * 29u) >> 8;
+}
+
+/**
+ * Filter one RGBA row pair only where the mask is, and blend it with the
+ * source by mask weight. Columns from the first to the last masked one
+ * are filtered like a segment, with the same warm-up and tail, so they
+ * come out the same as if the whole row pair was filtered. Row pairs
+ * without any mask are just copied.
+ */
+static void process_masked_pair(struct worker *worker, struct frame_job const *job, size_t pair)
+{
+    struct secamiz0r *self = worker->self;
+    size_t const width = self->width;
+
+    uint8_t const *src_rows[2] = {
+        &job->src[(pair * 2 + 0) * job->src_pitch],
+        &job->src[(pair * 2 + 1) * job->src_pitch],
+    };
+
+    uint8_t const *mask_rows[2] = {
+        &job->mask[(pair * 2 + 0) * job->src_pitch],
+        &job->mask[(pair * 2 + 1) * job->src_pitch],
+    };
+
+    uint8_t *dst_rows[2] = {
+        &job->dst[(pair * 2 + 0) * job->dst_pitch],
+        &job->dst[(pair * 2 + 1) * job->dst_pitch],
+    };
+
+    size_t x0 = width;
+    size_t x1 = 0;
+
+    for (int r = 0; r < 2; r++) {
+        for (size_t x = 0; x < x0; x++) {
+            if (mask_weight(&mask_rows[r][x * 4])) {
+                x0 = x;
+                break;
+            }
+        }
+
+        for (size_t x = width; x > x1; x--) {
+            if (mask_weight(&mask_rows[r][x * 4 - 4])) {
+                x1 = x;
+                break;
+            }
+        }
+    }
+
+    if (x0 >= x1) {
+        for (int r = 0; r < 2; r++) {
+            if (dst_rows[r] != src_rows[r]) {
+                memcpy(dst_rows[r], src_rows[r], width * 4);
+            }
+        }
+
+        add_pair_to_proxy(worker, job, pair, 0, width);
+        return;
+    }
+
+    // Chroma is taken from pairs of columns starting at even ones, so the
+    // span has to start and end at even columns too; starting it at
+    // a block of the generator lets it use noise generated ahead.
+    size_t const lo = ((x0 > SEGMENT_WARMUP) ? (x0 - SEGMENT_WARMUP) : 0) / RNG_BLOCK * RNG_BLOCK;
+    size_t const hi = (x1 + SEGMENT_TAIL + 1 < width) ? ((x1 + SEGMENT_TAIL + 1) & ~(size_t) 1) : width;
+
+    struct span const span = {
+        .frame_index = job->frame_index, .pair = job->first_pair + pair, .x = lo, .width = hi - lo,
+        .stats = &worker->stats, .params = job->params, .noise = get_span_noise(self, job, pair, lo),
+        .skip_left = x0 - lo, .skip_right = hi - x1,
+    };
+
+    uint8_t *even = &worker->scratch[0];
+    uint8_t *odd = &worker->scratch[span.width * 4];
+
+    TRACE_START(self, pair, 0);
+    copy_pair_as_yuv(self, even, odd, &src_rows[0][lo * 4], &src_rows[1][lo * 4], span.width);
+    TRACE_STAGE(self, "copy_pair_as_yuv", pair, 0);
+    prefilter_pair(self, even, odd, &span);
+    TRACE_STAGE(self, "prefilter_pair", pair, 0);
+    filter_pair(self, even, odd, &span);
+    TRACE_STAGE(self, "filter_pair", pair, 0);
+
+    uint8_t *filtered_rows[2] = { &even[(x0 - lo) * 4], &odd[(x0 - lo) * 4] };
+
+    convert_pair_to_rgb(self, filtered_rows[0], filtered_rows[1], hi - x0);
+
+    // Blend while the filtered rows are still in cache. Source may be
+    // the same buffer as the destination, so copy around the masked
+    // columns only when it's not.
+    for (int r = 0; r < 2; r++) {
+        uint8_t const *src = src_rows[r];
+        uint8_t const *mask = mask_rows[r];
+        uint8_t const *filtered = filtered_rows[r] - x0 * 4;
+        uint8_t *dst = dst_rows[r];
+
+        if (dst != src) {
+            memcpy(dst, src, x0 * 4);
+            memcpy(&dst[x1 * 4], &src[x1 * 4], (width - x1) * 4);
+        }
+
+        for (size_t x = x0; x < x1; x++) {
+            unsigned int const w = mask_weight(&mask[x * 4]);
+
+            for (int c = 0; c < 4; c++) {
+                dst[x * 4 + c] = (uint8_t) ((src[x * 4 + c] * (255u - w) + filtered[x * 4 + c] * w + 127u) / 255u);
+            }
+        }
+    }
+
+    TRACE_STAGE(self, "blend", pair, 0);
+    add_pair_to_proxy(worker, job, pair, 0, width);
+}
+
+/**
+ * Filter one row pair as a whole. When the destination is RGBA, it is used
+ * as a working storage as usual. Otherwise, the row pair goes through
+ * the scratch buffer of the worker.
+ */
+static void process_pair(struct worker *worker, struct frame_job const *job, size_t pair)
+{
+    struct secamiz0r *self = worker->self;
+    struct span const span = {
+        .frame_index = job->frame_index, .pair = job->first_pair + pair, .x = 0, .width = self->width,
+        .stats = &worker->stats, .params = job->params, .noise = get_span_noise(self, job, pair, 0),
+        .skip_left = 0, .skip_right = 0,
+    };
+
+    uint8_t const *src_even = &job->src[(pair * 2 + 0) * job->src_pitch];
+    uint8_t const *src_odd = &job->src[(pair * 2 + 1) * job->src_pitch];
+
+    uint8_t *dst_even = &job->dst[(pair * 2 + 0) * job->dst_pitch];
+    uint8_t *dst_odd = &job->dst[(pair * 2 + 1) * job->dst_pitch];
+
+    if (job->sweep_count > 0) {
+        process_sweep(worker, job, pair);
+        return;
+    }
+
+    if (job->mask) {
+        process_masked_pair(worker, job, pair);
+        return;
+    }
+
+    if (!job->src_layout && !job->dst_layout) {
+        self->process_rgba_pair(self, dst_even, dst_odd, src_even, src_odd, &span);
+        add_pair_to_proxy(worker, job, pair, 0, self->width);
+        return;
+    }
+
+    uint8_t *even = job->dst_layout ? &worker->scratch[0] : dst_even;
+    uint8_t *odd = job->dst_layout ? &worker->scratch[span.width * 4] : dst_odd;
+
+    TRACE_START(self, pair, 0);
+
+    if (job->src_layout) {
+        copy_pair_from_packed(self, even, odd, src_even, src_odd, span.width, job->src_layout);
+    } else {
+        copy_pair_as_yuv(self, even, odd, src_even, src_odd, span.width);
+    }
+
+    TRACE_STAGE(self, "copy_pair", pair, 0);
+    prefilter_pair(self, even, odd, &span);
+    TRACE_STAGE(self, "prefilter_pair", pair, 0);
+    filter_pair(self, even, odd, &span);
+    TRACE_STAGE(self, "filter_pair", pair, 0);
+
+    if (job->dst_layout) {
+        convert_pair_to_packed(self, dst_even, dst_odd, even, odd, span.width, job->dst_layout);
+    } else {
+        convert_pair_to_rgb(self, even, odd, span.width);
+    }
+
+    TRACE_STAGE(self, "convert_pair", pair, 0);
+    add_pair_to_proxy(worker, job, pair, 0, self->width);
+}
+
+/**
+ * Stage 1 for any source format.
+ */
+static void copy_source_pair(struct secamiz0r *self, struct frame_job const *job, uint8_t *even, uint8_t *odd, uint8_t const *src_even, uint8_t const *src_odd, size_t width)
+{
+    if (job->src_layout) {
+        copy_pair_from_packed(self, even, odd, src_even, src_odd, width, job->src_layout);
+    } else {
+        copy_pair_as_yuv(self, even, odd, src_even, src_odd, width);
+    }
+}
+
+/**
+ * Filter a horizontal segment of a row pair. Neighbouring pixels around
+ * the segment are filtered as well in the scratch buffer, so that the state
+ * of the filter at the segment edges is the same as if the whole row pair
+ * was filtered, and only the segment itself is copied to the destination.
+ */
+static void process_segment(struct worker *worker, struct frame_job const *job, size_t pair, size_t segment)
+{
+    struct secamiz0r *self = worker->self;
+
+    size_t const x0 = segment * self->segment_width;
+    size_t const x1 = (x0 + self->segment_width < self->width) ? (x0 + self->segment_width) : self->width;
+    size_t const lo = (x0 > SEGMENT_WARMUP) ? (x0 - SEGMENT_WARMUP) : 0;
+    size_t const hi = (x1 + SEGMENT_TAIL < self->width) ? (x1 + SEGMENT_TAIL) : self->width;
+
+    struct span const span = {
+        .frame_index = job->frame_index, .pair = job->first_pair + pair, .x = lo, .width = hi - lo,
+        .stats = &worker->stats, .params = job->params, .noise = get_span_noise(self, job, pair, lo),
+        .skip_left = x0 - lo, .skip_right = hi - x1,
+    };
+
+    uint8_t const *src_even = &job->src[(pair * 2 + 0) * job->src_pitch];
+    uint8_t const *src_odd = &job->src[(pair * 2 + 1) * job->src_pitch];
+
+    uint8_t *dst_even = &job->dst[(pair * 2 + 0) * job->dst_pitch];
+    uint8_t *dst_odd = &job->dst[(pair * 2 + 1) * job->dst_pitch];
+
+    uint8_t *even = &worker->scratch[0];
+    uint8_t *odd = &worker->scratch[span.width * 4];
+
+    size_t const pixel_size = job->src_layout ? 2 : 4;
+
+    TRACE_START(self, pair, segment);
+
+    if (job->halo) {
+        // Filtering in place: columns of neighbouring segments may have
+        // been overwritten already, their source is taken from the halo.
+        if (x0 > lo) {
+            uint8_t const *left = &job->halo[((segment - 1) * self->height + pair * 2) * job->halo_pitch];
+
+            copy_source_pair(self, job, even, odd, left, &left[job->halo_pitch], x0 - lo);
+        }
+
+        copy_source_pair(self, job, &even[(x0 - lo) * 4], &odd[(x0 - lo) * 4],
+                         &src_even[x0 * pixel_size], &src_odd[x0 * pixel_size], x1 - x0);
+
+        if (hi > x1) {
+            uint8_t const *right = &job->halo[(segment * self->height + pair * 2) * job->halo_pitch + SEGMENT_WARMUP * pixel_size];
+
+            copy_source_pair(self, job, &even[(x1 - lo) * 4], &odd[(x1 - lo) * 4], right, &right[job->halo_pitch], hi - x1);
+        }
+    } else {
+        copy_source_pair(self, job, even, odd, &src_even[lo * pixel_size], &src_odd[lo * pixel_size], span.width);
+    }
+
+    TRACE_STAGE(self, "copy_pair", pair, segment);
+    prefilter_pair(self, even, odd, &span);
+    TRACE_STAGE(self, "prefilter_pair", pair, segment);
+    filter_pair(self, even, odd, &span);
+    TRACE_STAGE(self, "filter_pair", pair, segment);
+
+    even += (x0 - lo) * 4;
+    odd += (x0 - lo) * 4;
+
+    if (job->dst_layout) {
+        uint8_t *out_even = &worker->scratch[span.width * 8];
+        uint8_t *out_odd = &out_even[(hi - x0) * 2];
+
+        convert_pair_to_packed(self, out_even, out_odd, even, odd, hi - x0, job->dst_layout);
+        memcpy(&dst_even[x0 * 2], out_even, (x1 - x0) * 2);
+        memcpy(&dst_odd[x0 * 2], out_odd, (x1 - x0) * 2);
+    } else {
+        convert_pair_to_rgb(self, even, odd, hi - x0);
+        memcpy(&dst_even[x0 * 4], even, (x1 - x0) * 4);
+        memcpy(&dst_odd[x0 * 4], odd, (x1 - x0) * 4);
+    }
+
+    TRACE_STAGE(self, "convert_pair", pair, segment);
+    add_pair_to_proxy(worker, job, pair, x0, x1);
+}
+
+/**
+ * Process a band of row pairs, or a segment of it.
+ */
+static void run_job(struct worker *worker, struct frame_job const *job, size_t index)
+{
+    size_t const pairs = job->pairs;
+    size_t const band = index / job->segments;
+    size_t const segment = index % job->segments;
+    size_t const first = band * job->band_pairs;
+    size_t const last = (first + job->band_pairs < pairs) ? (first + job->band_pairs) : pairs;
+
+    TRACE_START(worker->self, first, segment);
+
+    for (size_t pair = first; pair < last; pair++) {
+        if (job->segments > 1) {
+            process_segment(worker, job, pair, segment);
+        } else {
+            process_pair(worker, job, pair);
+        }
+    }
+
+    TRACE_STAGE(worker->self, "band", first, segment);
+}
+
+/**
+ * Take jobs until there are none left.
+ */
+static void run_jobs(struct worker *worker)
+{
+    struct secamiz0r *self = worker->self;
+    struct frame_job const *job = &self->job;
+
+#ifdef SECAMIZ0R_THREADS
+    size_t index;
+
+    while ((index = atomic_fetch_add(&self->next_job, 1)) < job->jobs) {
+        run_job(worker, job, index);
+    }
+#else
+    for (size_t index = 0; index < job->jobs; index++) {
+        run_job(worker, job, index);
+    }
+#endif
+}
+
+#ifdef SECAMIZ0R_THREADS
+/**
+ * Helper threads sleep until there's a new frame to work on.
+ */
+static void *worker_main(void *arg)
+{
+    struct worker *worker = arg;
+    struct secamiz0r *self = worker->self;
+
+#ifdef SECAMIZ0R_TRACE
+    trace_thread = (uint32_t) (worker - self->workers);
+#endif
+
+    pthread_mutex_lock(&self->mutex);
+
+    while (1) {
+        while (worker->generation == self->generation && !self->quit) {
+            pthread_cond_wait(&self->start_cond, &self->mutex);
+        }
+
+        if (self->quit) {
+            break;
+        }
+
+        worker->generation = self->generation;
+        pthread_mutex_unlock(&self->mutex);
+
+        run_jobs(worker);
+
+        pthread_mutex_lock(&self->mutex);
+
+        if (--self->busy == 0) {
+            pthread_cond_signal(&self->done_cond);
+        }
+    }
+
+    pthread_mutex_unlock(&self->mutex);
+
+    return NULL;
+}
+#endif
+
+/**
+ * Stop helper threads and free everything they had.
+ */
+static void stop_workers(struct secamiz0r *self)
+{
+    if (!self->workers) {
+        return;
+    }
+
+#ifdef SECAMIZ0R_THREADS
+    pthread_mutex_lock(&self->mutex);
+    self->quit = 1;
+    pthread_cond_broadcast(&self->start_cond);
+    pthread_mutex_unlock(&self->mutex);
+
+    for (unsigned int i = 1; i < self->thread_count; i++) {
+        pthread_join(self->workers[i].thread, NULL);
+    }
+
+    self->quit = 0;
+#endif
+
+    for (unsigned int i = 0; i < self->thread_count; i++) {
+        add_stats(&self->stats, &self->workers[i].stats);
+        free(self->workers[i].scratch);
+        free(self->workers[i].proxy_sums);
+    }
+
+    free(self->workers);
+    self->workers = NULL;
+    self->thread_count = 0;
+}
+
+/**
+ * (Re)start helper threads. Zero means one thread per CPU.
+ * Without thread support only one thread is used anyway.
+ */
+static int set_thread_count(struct secamiz0r *self, unsigned int thread_count)
+{
+#ifdef SECAMIZ0R_THREADS
+    if (thread_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = (cpus > 0) ? (unsigned int) cpus : 1;
+    }
+#else
+    thread_count = 1;
+#endif
+
+    struct worker *workers = calloc(thread_count, sizeof(*workers));
+
+    if (!workers) {
+        return 0;
+    }
+
+    stop_workers(self);
+
+    self->workers = workers;
+    self->thread_count = 1;
+    self->workers[0].self = self;
+
+#ifdef SECAMIZ0R_THREADS
+    for (unsigned int i = 1; i < thread_count; i++) {
+        struct worker *worker = &self->workers[i];
+
+        worker->self = self;
+        worker->generation = self->generation;
+
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            break;
+        }
+
+        self->thread_count++;
+    }
+#endif
+
+    return 1;
+}
+
+/**
+ * Scratch buffers are needed only for packed output and for segments.
+ * Enough for two working rows and two packed rows of the full width.
+ */
+static int ensure_scratch(struct secamiz0r *self, unsigned int threads)
+{
+    for (unsigned int i = 0; i < threads; i++) {
+        if (!self->workers[i].scratch) {
+            self->workers[i].scratch = malloc((size_t) self->width * 12);
+
+            if (!self->workers[i].scratch) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Proxy sums of one row of the proxy, the widest being RGBA at 1/2.
+ */
+static int ensure_proxy_sums(struct secamiz0r *self, unsigned int threads)
+{
+    for (unsigned int i = 0; i < threads; i++) {
+        if (!self->workers[i].proxy_sums) {
+            self->workers[i].proxy_sums = malloc(sizeof(uint16_t) * ((size_t) self->width / 2) * 4);
+
+            if (!self->workers[i].proxy_sums) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * When a frame split into segments is filtered in place, each segment
+ * reads a few hundred columns of its neighbours to warm up, which the
+ * neighbours may have filtered already. Source columns around every
+ * segment boundary are saved before the frame is started.
+ */
+static int save_halo(struct secamiz0r *self)
+{
+    struct frame_job *job = &self->job;
+    size_t const pixel_size = job->src_layout ? 2 : 4;
+
+    job->halo_pitch = (SEGMENT_WARMUP + SEGMENT_TAIL) * pixel_size;
+
+    size_t const size = (job->segments - 1) * self->height * job->halo_pitch;
+
+    if (size > self->halo_size) {
+        uint8_t *halo = realloc(self->halo, size);
+
+        if (!halo) {
+            return 0;
+        }
+
+        self->halo = halo;
+        self->halo_size = size;
+    }
+
+    for (size_t segment = 1; segment < job->segments; segment++) {
+        size_t const x = segment * self->segment_width;
+        size_t const lo = x - SEGMENT_WARMUP;
+        size_t const hi = (x + SEGMENT_TAIL < self->width) ? (x + SEGMENT_TAIL) : self->width;
+        uint8_t *halo = &self->halo[(segment - 1) * self->height * job->halo_pitch];
+
+        for (size_t y = 0; y < job->pairs * 2; y++) {
+            memcpy(&halo[y * job->halo_pitch], &job->src[y * job->src_pitch + lo * pixel_size], (hi - lo) * pixel_size);
+        }
+    }
+
+    job->halo = self->halo;
+
+    return 1;
+}
+
+#ifdef SECAMIZ0R_THREADS
+/**
+ * Generator output filter_pair() runs on for every pixel of both lines
+ * of every row pair of a frame, as it is when whole row pairs are filtered.
+ * It depends on nothing but the frame index.
+ */
+static void generate_noise(struct secamiz0r const *self, int32_t *noise, size_t frame_index)
+{
+    for (size_t pair = 0; pair < self->height / 2; pair++) {
+        struct span const span = {
+            .frame_index = frame_index, .pair = pair, .x = 0, .width = self->width,
+            .stats = NULL, .params = NULL, .noise = NULL,
+            .skip_left = 0, .skip_right = 0,
+        };
+        int32_t *values = &noise[pair * self->width * 2];
+
+        int r_even = 0;
+        int r_odd = 0;
+
+        for (size_t x = 0; x < self->width; x++) {
+            if (x % RNG_BLOCK == 0) {
+                r_even = pair_seed(&span, 2, x);
+                r_odd = pair_seed(&span, 3, x);
+            }
+
+            values[x * 2 + 0] = r_even;
+            values[x * 2 + 1] = r_odd;
+
+            r_even = juice(r_even);
+            r_odd = juice(r_odd);
+        }
+    }
+}
+
+/**
+ * Noise helper thread sleeps until it's asked for a frame it doesn't have,
+ * and generates it into the buffer which isn't in use.
+ */
+static void *noise_main(void *arg)
+{
+    struct noise_ahead *ahead = arg;
+
+    pthread_mutex_lock(&ahead->mutex);
+
+    while (1) {
+        while (!ahead->requested && !ahead->quit) {
+            pthread_cond_wait(&ahead->cond, &ahead->mutex);
+        }
+
+        if (ahead->quit) {
+            break;
+        }
+
+        size_t const frame_index = ahead->request;
+        ahead->requested = 0;
+
+        if ((ahead->ready[0] && ahead->frame_index[0] == frame_index)
+            || (ahead->ready[1] && ahead->frame_index[1] == frame_index)) {
+            continue;
+        }
+
+        int const b = (ahead->in_use == 0) ? 1 : 0;
+
+        ahead->ready[b] = 0;
+        ahead->frame_index[b] = frame_index;
+        ahead->writing = b;
+        pthread_mutex_unlock(&ahead->mutex);
+
+        generate_noise(ahead->self, ahead->values[b], frame_index);
+
+        pthread_mutex_lock(&ahead->mutex);
+        ahead->ready[b] = 1;
+        ahead->writing = -1;
+        pthread_cond_broadcast(&ahead->cond);
+    }
+
+    pthread_mutex_unlock(&ahead->mutex);
+
+    return NULL;
+}
+
+/**
+ * Free noise buffers, pointers to them must not be used anymore.
+ */
+static void free_noise_ahead(struct noise_ahead *ahead)
+{
+    free(ahead->values[0]);
+    free(ahead->values[1]);
+    free(ahead);
+}
+
+/**
+ * Start the noise helper thread with two buffers of a frame each.
+ */
+static int start_noise_ahead(struct secamiz0r *self)
+{
+    size_t const count = (size_t) self->width * (self->height / 2) * 2;
+    struct noise_ahead *ahead = calloc(1, sizeof(*ahead));
+
+    if (!ahead) {
+        return 0;
+    }
+
+    ahead->self = self;
+    ahead->values[0] = malloc(sizeof(int32_t) * count);
+    ahead->values[1] = malloc(sizeof(int32_t) * count);
+    ahead->in_use = -1;
+    ahead->writing = -1;
+
+    if (!ahead->values[0] || !ahead->values[1]) {
+        free_noise_ahead(ahead);
+        return 0;
+    }
+
+    pthread_mutex_init(&ahead->mutex, NULL);
+    pthread_cond_init(&ahead->cond, NULL);
+
+    if (pthread_create(&ahead->thread, NULL, noise_main, ahead) != 0) {
+        pthread_cond_destroy(&ahead->cond);
+        pthread_mutex_destroy(&ahead->mutex);
+        free_noise_ahead(ahead);
+        return 0;
+    }
+
+    self->noise_ahead = ahead;
+
+    return 1;
+}
+#endif
+
+/**
+ * Stop the noise helper thread, if it's running.
+ */
+static void stop_noise_ahead(struct secamiz0r *self)
+{
+#ifdef SECAMIZ0R_THREADS
+    struct noise_ahead *ahead = self->noise_ahead;
+
+    if (!ahead) {
+        return;
+    }
+
+    pthread_mutex_lock(&ahead->mutex);
+    ahead->quit = 1;
+    pthread_cond_broadcast(&ahead->cond);
+    pthread_mutex_unlock(&ahead->mutex);
+
+    pthread_join(ahead->thread, NULL);
+    pthread_cond_destroy(&ahead->cond);
+    pthread_mutex_destroy(&ahead->mutex);
+    free_noise_ahead(ahead);
+
+    self->noise_ahead = NULL;
+    self->job.noise = NULL;
+#else
+    (void) self;
+#endif
+}
+
+/**
+ * Noise of the frame generated ahead, if the helper thread guessed it
+ * right, and ask for the frame after it. If the frame is being generated
+ * right now, waiting for it is still faster than generating it again.
+ * The buffer stays valid until the next frame is started.
+ */
+static int32_t const *take_noise(struct secamiz0r *self, size_t frame_index)
+{
+#ifdef SECAMIZ0R_THREADS
+    struct noise_ahead *ahead = self->noise_ahead;
+
+    if (!ahead) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&ahead->mutex);
+
+    while (ahead->writing >= 0 && ahead->frame_index[ahead->writing] == frame_index) {
+        pthread_cond_wait(&ahead->cond, &ahead->mutex);
+    }
+
+    ahead->in_use = -1;
+
+    for (int b = 0; b < 2; b++) {
+        if (ahead->ready[b] && ahead->frame_index[b] == frame_index) {
+            ahead->in_use = b;
+        }
+    }
+
+    ahead->request = frame_index + 1;
+    ahead->requested = 1;
+    pthread_cond_broadcast(&ahead->cond);
+
+    int32_t const *noise = (ahead->in_use >= 0) ? ahead->values[ahead->in_use] : NULL;
+
+    pthread_mutex_unlock(&ahead->mutex);
+
+    return noise;
+#else
+    (void) self;
+    (void) frame_index;
+
+    return NULL;
+#endif
+}
+
+/**
+ * Split the frame described by the job into bands and segments, and make
+ * sure the first workers, as many as threads, have all buffers they need
+ * for it. Frames filtered in slices have one thread.
+ */
+static int prepare_jobs(struct secamiz0r *self, unsigned int threads)
+{
+    struct frame_job *job = &self->job;
+
+    // Whatever was being filtered in slices is abandoned.
+    self->cursor = self->height / 2;
+
+    job->band_pairs = self->band_pairs;
+
+    // Bands are made of whole proxy rows, so that each of them
+    // is summed up by one worker.
+    if (job->proxy) {
+        size_t const pairs_per_row = job->proxy_factor / 2;
+        job->band_pairs = (job->band_pairs + pairs_per_row - 1) / pairs_per_row * pairs_per_row;
+    }
+
+    // Wide frames are split into segments only when there are
+    // threads to share them with, the result is the same anyway.
+    // Sweeps filter whole row pairs in their outputs.
+    job->segments = 1;
+
+    if (threads > 1 && self->width >= 2 * self->segment_width && !job->sweep_count && !job->mask) {
+        job->segments = (self->width + self->segment_width - 1) / self->segment_width;
+    }
+
+    size_t const bands = (job->pairs + job->band_pairs - 1) / job->band_pairs;
+    job->jobs = bands * job->segments;
+
+    if ((job->dst_layout || job->segments > 1 || job->mask) && !ensure_scratch(self, threads)) {
+        return 0;
+    }
+
+    if (job->proxy && !ensure_proxy_sums(self, threads)) {
+        return 0;
+    }
+
+    job->halo = NULL;
+
+    if (job->segments > 1 && job->src == job->dst && !save_halo(self)) {
+        return 0;
+    }
+
+    // Noise generated ahead starts from the first row pair of a frame.
+    job->noise = (job->first_pair == 0) ? take_noise(self, job->frame_index) : NULL;
+
+    return 1;
+}
+
+/**
+ * Account for a frame which is done.
+ */
+static void finish_frame(struct secamiz0r *self, double latency)
+{
+    self->latencies[self->frames % STATS_LATENCIES] = latency;
+    self->total_latency += latency;
+    self->frames++;
+
+    self->frame_count = self->job.frame_index + 1;
+}
+
+/**
+ * Split the frame described by the job between threads and filter it.
+ * Returns zero if even the calling thread alone couldn't get the buffers
+ * it needs, dst is left as it was then.
+ */
+static int run_frame(struct secamiz0r *self, size_t frame_index)
+{
+    struct frame_job *job = &self->job;
+
+    double const start_time = stats_clock();
+
+    job->frame_index = frame_index;
+
+    PROBE_FRAME(self, frame__start);
+    TRACE_START(self, -1, -1);
+
+    // If there's no memory for buffers of all workers, the calling
+    // thread filters the frame alone, as with a single thread.
+    unsigned int threads = self->thread_count;
+
+    if (!prepare_jobs(self, threads)) {
+        threads = 1;
+
+        if (!prepare_jobs(self, threads)) {
+            return 0;
+        }
+    }
+
+#ifdef SECAMIZ0R_THREADS
+    if (threads > 1) {
+        atomic_store(&self->next_job, 0);
+
+        pthread_mutex_lock(&self->mutex);
+        self->busy = self->thread_count - 1;
+        self->generation++;
+        pthread_cond_broadcast(&self->start_cond);
+        pthread_mutex_unlock(&self->mutex);
+
+        run_jobs(&self->workers[0]);
+
+        pthread_mutex_lock(&self->mutex);
+
+        while (self->busy > 0) {
+            pthread_cond_wait(&self->done_cond, &self->mutex);
+        }
+
+        pthread_mutex_unlock(&self->mutex);
+    } else {
+        atomic_store(&self->next_job, 0);
+        run_jobs(&self->workers[0]);
+    }
+#else
+    run_jobs(&self->workers[0]);
+#endif
+
+    TRACE_STAGE(self, "frame", -1, -1);
+    PROBE_FRAME(self, frame__end);
+
+    finish_frame(self, stats_clock() - start_time);
+
+    return 1;
+}
+
+/**
+ * Fast 64-bit hash of a whole frame, four independent lanes at a time.
+ * It's not meant to resist anything but accidental collisions.
+ */
+static uint64_t hash_frame(void const *frame, size_t size)
+{
+    uint8_t const *bytes = frame;
+    uint64_t const k = 0x9e3779b97f4a7c15ull;
+    uint64_t lanes[4] = { size, size ^ k, size + k, size - k };
+    size_t i = 0;
+
+    for (; i + 32 <= size; i += 32) {
+        for (int j = 0; j < 4; j++) {
+            uint64_t word;
+
+            memcpy(&word, &bytes[i + j * 8], 8);
+            lanes[j] = (lanes[j] ^ word) * k;
+            lanes[j] ^= lanes[j] >> 29;
+        }
+    }
+
+    for (; i < size; i++) {
+        lanes[0] = (lanes[0] ^ bytes[i]) * k;
+    }
+
+    uint64_t h = lanes[0];
+
+    for (int j = 1; j < 4; j++) {
+        h = (h ^ lanes[j]) * k;
+        h ^= h >> 32;
+    }
+
+    return h;
+}
+
+/**
+ * Frees least recently used frames until size more bytes fit the budget.
+ */
+static void evict_cached_frames(struct secamiz0r *self, size_t size)
+{
+    while (self->cache_count > 0 && self->cache_used + size > self->cache_budget) {
+        size_t oldest = 0;
+
+        for (size_t i = 1; i < self->cache_count; i++) {
+            if (self->cache[i].last_used < self->cache[oldest].last_used) {
+                oldest = i;
+            }
+        }
+
+        self->cache_used -= self->cache[oldest].size;
+        free(self->cache[oldest].data);
+        self->cache[oldest] = self->cache[--self->cache_count];
+    }
+}
+
+/**
+ * Copies a cached frame to the destination, if there is one.
+ */
+static int load_cached_frame(struct secamiz0r *self, struct cache_key const *key, void *dst, size_t size)
+{
+    for (size_t i = 0; i < self->cache_count; i++) {
+        struct cache_entry *entry = &self->cache[i];
+
+        if (!memcmp(&entry->key, key, sizeof(*key)) && entry->size == size) {
+            memcpy(dst, entry->data, size);
+            entry->last_used = ++self->cache_clock;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Keeps a copy of a freshly filtered frame, making room for it if needed.
+ * Frames which don't fit the budget at all aren't kept.
+ */
+static void save_cached_frame(struct secamiz0r *self, struct cache_key const *key, void const *dst, size_t size)
+{
+    if (size > self->cache_budget) {
+        return;
+    }
+
+    evict_cached_frames(self, size);
+
+    struct cache_entry *cache = realloc(self->cache, sizeof(*cache) * (self->cache_count + 1));
+
+    if (!cache) {
+        return;
+    }
+
+    self->cache = cache;
+
+    uint8_t *data = malloc(size);
+
+    if (!data) {
+        return;
+    }
+
+    memcpy(data, dst, size);
+
+    struct cache_entry *entry = &self->cache[self->cache_count++];
+
+    entry->key = *key;
+    entry->last_used = ++self->cache_clock;
+    entry->size = size;
+    entry->data = data;
+
+    self->cache_used += size;
+}
+
+/**
+ * Extended API: set memory budget of the output cache.
+ */
+void secamiz0r_set_cache(f0r_instance_t instance, size_t budget)
+{
+    struct secamiz0r *self = instance;
+
+    self->cache_budget = budget;
+    evict_cached_frames(self, 0);
+
+    if (self->cache_count == 0) {
+        free(self->cache);
+        self->cache = NULL;
+    }
+}
+
+/**
+ * Extended API: set frame rate of the time passed with the cache on.
+ */
+void secamiz0r_set_frame_rate(f0r_instance_t instance, double frame_rate)
+{
+    struct secamiz0r *self = instance;
+
+    self->frame_rate = (frame_rate > 0.0) ? frame_rate : 25.0;
+}
+
+/**
+ * Point the job at source and destination frames, and the proxy if any.
+ */
+static void set_frame_buffers(struct secamiz0r *self,
+                              void const *src, enum secamiz0r_format src_format,
+                              void *dst, enum secamiz0r_format dst_format)
+{
+    struct frame_job *job = &self->job;
+
+    take_params(self, &job->snapshot);
+
+    job->first_pair = 0;
+    job->pairs = self->height / 2;
+    job->params = &job->snapshot;
+    job->sweep_dst = NULL;
+    job->sweep_count = 0;
+    job->mask = NULL;
+
+    job->src = src;
+    job->src_layout = get_packed_layout(src_format);
+    job->src_pitch = self->width * (job->src_layout ? 2 : 4);
+
+    job->dst = dst;
+    job->dst_layout = get_packed_layout(dst_format);
+    job->dst_pitch = self->width * (job->dst_layout ? 2 : 4);
+
+    job->proxy = self->proxy;
+    job->proxy_factor = self->proxy_factor;
+
+    if (job->proxy) {
+        job->proxy_width = self->width / job->proxy_factor;
+        job->proxy_height = self->height / job->proxy_factor;
+
+        if (job->dst_layout) {
+            job->proxy_width &= ~(size_t) 1;
+        }
+
+        job->proxy_pitch = job->proxy_width * (job->dst_layout ? 2 : 4);
+    }
+}
+
+/**
+ * Filter the frame the job points at, or copy it from the cache if it was
+ * filtered recently from the same source, mask and parameters.
+ */
+static void run_cached_frame(struct secamiz0r *self, size_t frame_index,
+                             enum secamiz0r_format src_format, enum secamiz0r_format dst_format)
+{
+    struct frame_job const *job = &self->job;
+
+    // Proxies aren't cached, so frames which need one are always filtered.
+    if (!self->cache_budget || self->proxy) {
+        run_frame(self, frame_index);
+        return;
+    }
+
+    // Parameters are taken from the snapshot the frame would use.
+    struct cache_key key;
+
+    memset(&key, 0, sizeof(key));
+    key.src_hash = hash_frame(job->src, secamiz0r_frame_size(self->width, self->height, src_format));
+    key.mask_hash = job->mask ? hash_frame(job->mask, secamiz0r_frame_size(self->width, self->height, src_format)) : 0;
+    key.fire_intensity = job->params->fire_intensity;
+    key.noise_intensity = job->params->noise_intensity;
+    key.frame_index = frame_index;
+    key.src_format = (int) src_format;
+    key.dst_format = (int) dst_format;
+
+    size_t const size = secamiz0r_frame_size(self->width, self->height & ~1u, dst_format);
+
+    if (load_cached_frame(self, &key, job->dst, size)) {
+        // The job points at this frame now, so a frame being filtered
+        // in slices is abandoned as if this one had been filtered.
+        self->cursor = self->height / 2;
+        self->frame_count = frame_index + 1;
+        return;
+    }
+
+    if (run_frame(self, frame_index)) {
+        save_cached_frame(self, &key, job->dst, size);
+    }
+}
+
+/**
+ * Extended API: the whole process of filtering, for any combination of
+ * source and destination formats.
+ */
+void secamiz0r_update_frame(f0r_instance_t instance, size_t frame_index,
+                            void const *src, enum secamiz0r_format src_format,
+                            void *dst, enum secamiz0r_format dst_format)
+{
+    struct secamiz0r *self = instance;
+
+    set_frame_buffers(self, src, src_format, dst, dst_format);
+    run_cached_frame(self, frame_index, src_format, dst_format);
+}
+
+/**
+ * Extended API: filter a strip of row pairs of a frame taller than
+ * the instance.
+ */
+int secamiz0r_update_strip(f0r_instance_t instance, size_t frame_index, size_t first_pair, size_t pairs,
+                           void const *src, enum secamiz0r_format src_format,
+                           void *dst, enum secamiz0r_format dst_format)
+{
+    struct secamiz0r *self = instance;
+
+    if (pairs > self->height / 2) {
+        return 0;
+    }
+
+    if (pairs == 0) {
+        return 1;
+    }
+
+    set_frame_buffers(self, src, src_format, dst, dst_format);
+
+    // Proxy rows are made of whole frames, strips don't have them.
+    self->job.first_pair = first_pair;
+    self->job.pairs = pairs;
+    self->job.proxy = NULL;
+
+    return run_frame(self, frame_index);
+}
+
+/**
+ * Extended API: start filtering a frame in slices.
+ */
+int secamiz0r_begin_frame(f0r_instance_t instance, size_t frame_index,
+                          void const *src, enum secamiz0r_format src_format,
+                          void *dst, enum secamiz0r_format dst_format)
+{
+    struct secamiz0r *self = instance;
+
+    set_frame_buffers(self, src, src_format, dst, dst_format);
+    self->job.frame_index = frame_index;
+
+    if (!prepare_jobs(self, 1)) {
+        return 0;
+    }
+
+    self->cursor = 0;
+    self->slice_latency = 0.0;
+
+    PROBE_FRAME(self, frame__start);
+
+    return 1;
+}
+
+/**
+ * Extended API: filter the next slice of the frame started with
+ * secamiz0r_begin_frame(), on the calling thread. The clock is checked
+ * after every row pair, so a slice overruns its time by one row pair
+ * at most.
+ */
+size_t secamiz0r_resume_frame(f0r_instance_t instance, size_t max_pairs, double max_seconds)
+{
+    struct secamiz0r *self = instance;
+    size_t const pairs = self->height / 2;
+    size_t const first = self->cursor;
+
+    if (first >= pairs) {
+        return pairs;
+    }
+
+    double const start_time = stats_clock();
+    double elapsed = 0.0;
+
+    TRACE_START(self, first, -1);
+
+    do {
+        process_pair(&self->workers[0], &self->job, self->cursor++);
+        elapsed = stats_clock() - start_time;
+    } while (self->cursor < pairs
+             && (max_pairs == 0 || self->cursor - first < max_pairs)
+             && (max_seconds <= 0.0 || elapsed < max_seconds));
+
+    TRACE_STAGE(self, "slice", first, -1);
+
+    self->slice_latency += elapsed;
+
+    if (self->cursor == pairs) {
+        PROBE_FRAME(self, frame__end);
+        finish_frame(self, self->slice_latency);
+    }
+
+    return self->cursor;
+}
+
+/**
+ * Extended API: filter one frame with several sets of parameters.
+ */
+int secamiz0r_update_sweep(f0r_instance_t instance, size_t frame_index, uint32_t const *src,
+                           struct secamiz0r_params const *params, uint32_t *const *dst, size_t count)
+{
+    struct secamiz0r *self = instance;
+    struct frame_job *job = &self->job;
+
+    if (count == 0) {
+        return 1;
+    }
+
+    if (count > self->sweep_capacity) {
+        struct params *sweep_params = realloc(self->sweep_params, sizeof(*sweep_params) * count);
+
+        if (!sweep_params) {
+            return 0;
+        }
+
+        self->sweep_params = sweep_params;
+        self->sweep_capacity = count;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        set_fire_intensity(&self->sweep_params[i], params[i].fire_intensity);
+        set_noise_intensity(&self->sweep_params[i], params[i].noise_intensity);
+    }
+
+    job->first_pair = 0;
+    job->pairs = self->height / 2;
+    job->params = self->sweep_params;
+    job->sweep_dst = dst;
+    job->sweep_count = count;
+
+    job->src = (uint8_t const *) src;
+    job->src_layout = NULL;
+    job->src_pitch = self->width * 4;
+
+    job->dst = (uint8_t *) dst[0];
+    job->dst_layout = NULL;
+    job->dst_pitch = self->width * 4;
+
+    job->proxy = NULL;
+    job->mask = NULL;
+
+    return run_frame(self, frame_index);
+}
+
+/**
+ * Extended API: set number of threads used by the instance.
+ */
+int secamiz0r_set_threads(f0r_instance_t instance, unsigned int thread_count)
+{
+    return set_thread_count(instance, thread_count);
+}
+
+/**
+ * Extended API: write downscaled copies of following frames to proxy.
+ */
+int secamiz0r_set_proxy(f0r_instance_t instance, void *proxy, unsigned int factor)
+{
+    struct secamiz0r *self = instance;
+
+    if (proxy && factor != 2 && factor != 4 && factor != 8) {
+        return 0;
+    }
+
+    self->proxy = proxy;
+    self->proxy_factor = proxy ? factor : 0;
+
+    return !proxy || ensure_proxy_sums(self, self->thread_count);
+}
+
+/**
+ * Extended API: generate noise of the next frame on a helper thread.
+ */
+int secamiz0r_set_noise_ahead(f0r_instance_t instance, int enabled)
+{
+    struct secamiz0r *self = instance;
+
+    if (!enabled) {
+        stop_noise_ahead(self);
+        return 1;
+    }
+
+#ifdef SECAMIZ0R_THREADS
+    return self->noise_ahead || start_noise_ahead(self);
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Extended API: pick the fastest configuration for the instance.
+ */
+void secamiz0r_autotune(f0r_instance_t instance, int tune_threads)
+{
+    autotune(instance, tune_threads);
+}
+
+/**
+ * Extended API: number of threads actually used by the instance.
+ */
+unsigned int secamiz0r_get_threads(f0r_instance_t instance)
+{
+    struct secamiz0r *self = instance;
+
+    return self->thread_count;
+}
+
+/**
+ * Extended API: dump recorded events in Chrome's trace event format.
+ * Times are in microseconds since the oldest event still in the buffer.
+ */
+int secamiz0r_write_trace(f0r_instance_t instance, char const *path)
+{
+#ifdef SECAMIZ0R_TRACE
+    struct secamiz0r *self = instance;
+
+    if (!self->trace) {
+        return 0;
+    }
+
+    FILE *file = fopen(path, "w");
+
+    if (!file) {
+        return 0;
+    }
+
+    size_t const next = self->trace_next;
+    size_t const count = (next < self->trace_capacity) ? next : self->trace_capacity;
+    size_t const oldest = next - count;
+
+    uint64_t origin = UINT64_MAX;
+
+    for (size_t i = 0; i < count; i++) {
+        struct trace_event const *event = &self->trace[(oldest + i) % self->trace_capacity];
+
+        if (event->begin < origin) {
+            origin = event->begin;
+        }
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+
+    for (unsigned int i = 0; i < self->thread_count; i++) {
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"name\":\"%s %u\"}}%s\n",
+                i, (i == 0) ? "caller" : "worker", i,
+                (i + 1 < self->thread_count || count > 0) ? "," : "");
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        struct trace_event const *event = &self->trace[(oldest + i) % self->trace_capacity];
+
+        fprintf(file, "{\"name\":\"%s\",\"cat\":\"secamiz0r\",\"ph\":\"X\","
+                "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"frame\":%llu,\"pair\":%d,\"segment\":%d}}%s\n",
+                event->name,
+                (event->begin - origin) / 1e3,
+                (event->end - event->begin) / 1e3,
+                (unsigned int) event->thread,
+                (unsigned long long) event->frame,
+                (int) event->pair,
+                (int) event->segment,
+                (i + 1 < count) ? "," : "");
+    }
+
+    fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+
+    return fclose(file) == 0;
+#else
+    (void) instance;
+    (void) path;
+    return 0;
+#endif
+}
+
+/**
+ * Index of the frame at the given time. With the cache, the same time
+ * must give the same frame no matter what was filtered before it, so the
+ * index comes from time alone. Its lowest bit is the parity of the frame
+ * number, so line shifts still alternate from one frame to the next.
+ * Without the cache, it's the frame after the previous one.
+ */
+static size_t get_time_frame_index(struct secamiz0r const *self, double time)
+{
+    if (!self->cache_budget) {
+        return self->frame_count;
+    }
+
+    double const frames = time * self->frame_rate;
+    int64_t const number = (int64_t) (frames + ((frames < 0.0) ? -0.5 : 0.5));
+    uint64_t const us = (uint64_t) (int64_t) (time * 1e6 + ((time < 0.0) ? -0.5 : 0.5));
+    uint64_t const hash = ((uint64_t) hash32((uint32_t) (us >> 32)) << 32) | hash32((uint32_t) us);
+
+    return (size_t) ((hash & ~(uint64_t) 1) | ((uint64_t) number & 1));
+}
+
+/**
+ * Extended API: filter the frame which comes next after the previous one.
+ */
+void secamiz0r_update_format(f0r_instance_t instance, double time,
+                             void const *src, enum secamiz0r_format src_format,
+                             void *dst, enum secamiz0r_format dst_format)
+{
+    struct secamiz0r *self = instance;
+
+    secamiz0r_update_frame(instance, get_time_frame_index(self, time), src, src_format, dst, dst_format);
+}
+
+/**
+ * The whole process of filtering is done here.
+ * This function is called every frame.
+ */
+void f0r_update(f0r_instance_t instance, double time, uint32_t const* src, uint32_t *dst)
+{
+    secamiz0r_update_format(instance, time, src, SECAMIZ0R_FORMAT_RGBA8888, dst, SECAMIZ0R_FORMAT_RGBA8888);
+}
+
+#ifdef SECAMIZ0R_MASK
+/**
+ * Mixer variant: the first input is filtered only where the second one
+ * is bright, row pairs and spans outside of it cost nothing but a copy.
+ * Frames are numbered and cached as by f0r_update(), the mask being
+ * part of the cache key. The third input is not used.
+ */
+void f0r_update2(f0r_instance_t instance, double time,
+                 uint32_t const *inframe1, uint32_t const *inframe2, uint32_t const *inframe3,
+                 uint32_t *outframe)
+{
+    struct secamiz0r *self = instance;
+    size_t const frame_index = get_time_frame_index(self, time);
+
+    (void) inframe3;
+
+    set_frame_buffers(self, inframe1, SECAMIZ0R_FORMAT_RGBA8888, outframe, SECAMIZ0R_FORMAT_RGBA8888);
+    self->job.mask = (uint8_t const *) inframe2;
+    run_cached_frame(self, frame_index, SECAMIZ0R_FORMAT_RGBA8888, SECAMIZ0R_FORMAT_RGBA8888);
+}
+#endif
+
+/**
+ * Configuration picked by the autotuner.
+ */
+struct tuning
+{
+    size_t band_pairs;
+    unsigned int thread_count;
+    int specialized;
+};
+
+/**
+ * Path of the file where tuning results are kept:
+ * $XDG_CACHE_HOME/secamiz0r/autotune, ~/.cache/secamiz0r/autotune
+ * or %LOCALAPPDATA%\secamiz0r\autotune. The directory is created
+ * if needed.
+ */
+static int get_tuning_path(char *path, size_t size)
+{
+    char dir[1024];
+    int length;
+
+#ifdef _WIN32
+    char const *base = getenv("LOCALAPPDATA");
+
+    if (!base) {
+        return 0;
+    }
+
+    length = snprintf(dir, sizeof(dir), "%s\\secamiz0r", base);
+#else
+    char const *base = getenv("XDG_CACHE_HOME");
+    char const *home = getenv("HOME");
+
+    if (base && base[0]) {
+        length = snprintf(dir, sizeof(dir), "%s/secamiz0r", base);
+    } else if (home && home[0]) {
+        length = snprintf(dir, sizeof(dir), "%s/.cache/secamiz0r", home);
+    } else {
+        return 0;
+    }
+#endif
+
+    if (length < 0 || (size_t) length >= sizeof(dir)) {
+        return 0;
+    }
+
+#ifdef _WIN32
+    _mkdir(dir);
+#else
+    // Parent of the cache directory may not exist either.
+    char *slash = strrchr(dir, '/');
+
+    *slash = '\0';
+    mkdir(dir, 0700);
+    *slash = '/';
+    mkdir(dir, 0700);
+#endif
+
+    length = snprintf(path, size, "%s%cautotune", dir, DIRECTORY_SEPARATOR);
+
+    return length > 0 && (size_t) length < size;
+}
+
+/**
+ * Results depend on the frame size and the machine: the CPU model and the
+ * number of CPUs available. Key is a single line without spaces around.
+ */
+static void get_tuning_key(struct secamiz0r *self, char *key, size_t size)
+{
+    char model[128] = "unknown";
+    long cpus = 1;
+
+#ifdef __linux__
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+
+    if (cpuinfo) {
+        char line[256];
+
+        while (fgets(line, sizeof(line), cpuinfo)) {
+            char *colon = strchr(line, ':');
+
+            if (!strncmp(line, "model name", 10) && colon) {
+                snprintf(model, sizeof(model), "%s", colon + 2);
+                model[strcspn(model, "\r\n")] = '\0';
+                break;
+            }
+        }
+
+        fclose(cpuinfo);
+    }
+#endif
+
+#ifdef SECAMIZ0R_THREADS
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    snprintf(key, size, "%ux%u %ld %s", self->width, self->height, cpus, model);
+}
+
+/**
+ * Look for the key in the cache file. Each line is "band_pairs thread_count
+ * specialized key".
+ */
+static int load_tuning(char const *path, char const *key, struct tuning *tuning)
+{
+    FILE *file = fopen(path, "r");
+
+    if (!file) {
+        return 0;
+    }
+
+    char line[512];
+    int found = 0;
+
+    while (!found && fgets(line, sizeof(line), file)) {
+        unsigned long band_pairs;
+        unsigned int thread_count;
+        int specialized;
+        int offset;
+
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (sscanf(line, "%lu %u %d %n", &band_pairs, &thread_count, &specialized, &offset) == 3
+            && !strcmp(&line[offset], key) && band_pairs > 0) {
+            tuning->band_pairs = band_pairs;
+            tuning->thread_count = thread_count;
+            tuning->specialized = specialized;
+            found = 1;
+        }
+    }
+
+    fclose(file);
+
+    return found;
+}
+
+/**
+ * Add a line to the cache file. Other instances may be doing the same
+ * at the same time, so the file is only ever appended to, and a line is
+ * written with a single call.
+ */
+static void save_tuning(char const *path, char const *key, struct tuning const *tuning)
+{
+    FILE *file = fopen(path, "a");
+
+    if (!file) {
+        return;
+    }
+
+    char line[512];
+
+    snprintf(line, sizeof(line), "%lu %u %d %s\n",
+             (unsigned long) tuning->band_pairs, tuning->thread_count, tuning->specialized, key);
+    fputs(line, file);
+    fclose(file);
+}
+
+static void apply_tuning(struct secamiz0r *self, struct tuning const *tuning, int tune_threads)
+{
+    self->band_pairs = tuning->band_pairs;
+    self->process_rgba_pair = tuning->specialized ? choose_rgba_kernel(self->width) : process_rgba_pair_any;
+
+    if (tune_threads && tuning->thread_count != self->thread_count) {
+        set_thread_count(self, tuning->thread_count);
+    }
+}
+
+/**
+ * Best of a few frames filtered with the given configuration, in seconds.
+ */
+static double time_tuning(struct secamiz0r *self, struct tuning const *tuning, int tune_threads, uint8_t const *src, uint8_t *dst)
+{
+    double best = HUGE_VAL;
+
+    apply_tuning(self, tuning, tune_threads);
+
+    for (int i = 0; i < AUTOTUNE_FRAMES; i++) {
+        double const start = stats_clock();
+
+        secamiz0r_update_frame(self, (size_t) i, src, SECAMIZ0R_FORMAT_RGBA8888, dst, SECAMIZ0R_FORMAT_RGBA8888);
+
+        double const elapsed = stats_clock() - start;
+
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * Pick the fastest configuration for this frame size and machine, or take
+ * the one found before from the cache. Parameters are tuned one after
+ * another (kernel, threads, band size) instead of trying every combination,
+ * which keeps the first run short. Thread count is left alone when it's
+ * set explicitly.
+ */
+static void autotune(struct secamiz0r *self, int tune_threads)
+{
+    char path[1100];
+    char key[256];
+    struct tuning best = { self->band_pairs, self->thread_count, 1 };
+
+    if (!get_tuning_path(path, sizeof(path))) {
+        return;
+    }
+
+    get_tuning_key(self, key, sizeof(key));
+
+    if (load_tuning(path, key, &best)) {
+        apply_tuning(self, &best, tune_threads);
+        return;
+    }
+
+    size_t const size = (size_t) self->width * self->height * 4;
+    uint8_t *src = malloc(size);
+    uint8_t *dst = malloc(size);
+
+    if (!src || !dst) {
+        free(src);
+        free(dst);
+        return;
+    }
+
+    // Something with edges, so that fire code runs as usual.
+    for (size_t i = 0; i < size; i++) {
+        src[i] = (uint8_t) ((i * 7) ^ (i / (self->width * 4) * 13));
+    }
+
+    double best_time = time_tuning(self, &best, tune_threads, src, dst);
+
+    if (choose_rgba_kernel(self->width) != process_rgba_pair_any) {
+        struct tuning candidate = best;
+
+        candidate.specialized = 0;
+
+        double const time = time_tuning(self, &candidate, tune_threads, src, dst);
+
+        if (time < best_time) {
+            best = candidate;
+            best_time = time;
+        }
+    }
+
+#ifdef SECAMIZ0R_THREADS
+    if (tune_threads) {
+        long const cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        unsigned int const candidates[] = { 1, (unsigned int) (cpus / 2), (unsigned int) cpus };
+
+        for (size_t i = 0; i < sizeof(candidates) / sizeof(*candidates); i++) {
+            struct tuning candidate = best;
+
+            if (candidates[i] < 1 || candidates[i] == best.thread_count) {
+                continue;
+            }
+
+            candidate.thread_count = candidates[i];
+
+            double const time = time_tuning(self, &candidate, tune_threads, src, dst);
+
+            if (time < best_time) {
+                best = candidate;
+                best_time = time;
+            }
+        }
+    }
+#endif
+
+    for (size_t band_pairs = 2; band_pairs <= 64; band_pairs *= 2) {
+        struct tuning candidate = best;
+
+        if (band_pairs == best.band_pairs) {
+            continue;
+        }
+
+        candidate.band_pairs = band_pairs;
+
+        double const time = time_tuning(self, &candidate, tune_threads, src, dst);
+
+        if (time < best_time) {
+            best = candidate;
+            best_time = time;
+        }
+    }
+
+    free(src);
+    free(dst);
+
+    apply_tuning(self, &best, tune_threads);
+    save_tuning(path, key, &best);
+
+    // Tuning frames don't count.
+    memset(&self->stats, 0, sizeof(self->stats));
+
+    for (unsigned int i = 0; i < self->thread_count; i++) {
+        memset(&self->workers[i].stats, 0, sizeof(self->workers[i].stats));
+    }
+
+    self->frames = 0;
+    self->total_latency = 0.0;
+    self->frame_count = 0;
 }
@@ -0,0 +1,224 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r.h: extended API for applications embedding secamiz0r directly.
+ * Instances are still created with f0r_construct() and configured with
+ * f0r_set_param_value(), these functions only add what frei0r can't express.
+ */
+
+#ifndef SECAMIZ0R_H
+#define SECAMIZ0R_H
+
+#include <stddef.h>
+#include "frei0r.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Pixel formats of frames passed to secamiz0r_update_format().
+ * Rows are tightly packed, width must be even.
+ */
+enum secamiz0r_format
+{
+    SECAMIZ0R_FORMAT_RGBA8888,  // same as F0R_COLOR_MODEL_RGBA8888
+    SECAMIZ0R_FORMAT_UYVY,      // packed 4:2:2, bytes U0 Y0 V0 Y1
+    SECAMIZ0R_FORMAT_YUY2,      // packed 4:2:2, bytes Y0 U0 Y1 V0
+};
+
+/**
+ * Size of a single frame in bytes.
+ */
+size_t secamiz0r_frame_size(unsigned int width, unsigned int height, enum secamiz0r_format format);
+
+/**
+ * Same as f0r_update(), but source and destination frames may be in any
+ * of the supported pixel formats. Packed 4:2:2 frames are fed to the filter
+ * as is, without going through RGB.
+ * src and dst may be the same buffer if both formats are the same. This
+ * holds for every function below that takes a source and a destination.
+ */
+void secamiz0r_update_format(f0r_instance_t instance, double time,
+                             void const *src, enum secamiz0r_format src_format,
+                             void *dst, enum secamiz0r_format dst_format);
+
+/**
+ * Same as secamiz0r_update_format(), but the frame index is given explicitly
+ * instead of counting calls. Noise and line shifts depend only on the frame
+ * index, so a frame rendered by this function is identical to the same
+ * frame rendered in sequence, by this or any other instance.
+ * Following calls to secamiz0r_update_format() continue from frame_index + 1.
+ */
+void secamiz0r_update_frame(f0r_instance_t instance, size_t frame_index,
+                            void const *src, enum secamiz0r_format src_format,
+                            void *dst, enum secamiz0r_format dst_format);
+
+/**
+ * Filter a horizontal strip of a frame too big to be kept in memory:
+ * pairs row pairs starting from row pair first_pair, that is rows
+ * 2 * first_pair to 2 * (first_pair + pairs) - 1 of the frame. src and dst
+ * hold these rows only. The instance is created with the width of the
+ * frame and the height of a strip, pairs may not exceed half of it.
+ * Row pairs are filtered independently, so strips put together are the
+ * same as the whole frame filtered by secamiz0r_update_frame(). Strips
+ * are neither written to the proxy nor cached, and count as frames in
+ * statistics. Returns zero if pairs is too big for the instance
+ * or out of memory.
+ */
+int secamiz0r_update_strip(f0r_instance_t instance, size_t frame_index, size_t first_pair, size_t pairs,
+                           void const *src, enum secamiz0r_format src_format,
+                           void *dst, enum secamiz0r_format dst_format);
+
+/**
+ * Start filtering a frame in slices, for hosts which can't afford to block
+ * for a whole frame. Arguments are the same as for secamiz0r_update_frame(),
+ * frames must stay valid until the last slice is done. Nothing is filtered
+ * until secamiz0r_resume_frame() is called. Any other call which filters
+ * a frame with the same instance abandons the one in progress.
+ * Returns zero if out of memory.
+ */
+int secamiz0r_begin_frame(f0r_instance_t instance, size_t frame_index,
+                          void const *src, enum secamiz0r_format src_format,
+                          void *dst, enum secamiz0r_format dst_format);
+
+/**
+ * Filter the next slice of the frame started by secamiz0r_begin_frame()
+ * on the calling thread: at least one row pair, at most max_pairs of
+ * them, and no more after max_seconds have passed. Zero means no limit.
+ * Returns the number of row pairs done so far; the frame is complete when
+ * it reaches height / 2, and is then the same as if it was filtered by
+ * a single call to secamiz0r_update_frame().
+ */
+size_t secamiz0r_resume_frame(f0r_instance_t instance, size_t max_pairs, double max_seconds);
+
+/**
+ * Values of both intensity parameters, for secamiz0r_update_sweep().
+ */
+struct secamiz0r_params
+{
+    double fire_intensity;
+    double noise_intensity;
+};
+
+/**
+ * Filter the same RGBA frame with count sets of parameters at once, for
+ * previews of many intensities. Output i is the same as frame frame_index
+ * rendered by secamiz0r_update_frame() with params[i], but the source
+ * is converted to YUV only once for all of them. Parameters of the
+ * instance itself are not changed. Returns zero if out of memory.
+ */
+int secamiz0r_update_sweep(f0r_instance_t instance, size_t frame_index, uint32_t const *src,
+                           struct secamiz0r_params const *params, uint32_t *const *dst, size_t count);
+
+/**
+ * Set number of threads the instance splits each frame between, including
+ * the calling one. Zero means one thread per CPU. Frames are split into
+ * bands of row pairs, very wide frames into horizontal segments as well.
+ * Output doesn't depend on the number of threads.
+ * The default is the value of SECAMIZ0R_NUM_THREADS environment variable
+ * if it's set, otherwise 1, or what the autotuner picked if it was asked to.
+ * Returns zero if out of memory.
+ */
+int secamiz0r_set_threads(f0r_instance_t instance, unsigned int thread_count);
+
+/**
+ * Pick the fastest band size, kernel variant and, if tune_threads is
+ * non-zero, number of threads for the frame size of the instance on this
+ * machine. The first time, a few dozen frames are filtered, and the result
+ * is saved to $XDG_CACHE_HOME/secamiz0r/autotune; later calls just read it.
+ * f0r_construct() does this itself only if SECAMIZ0R_AUTOTUNE environment
+ * variable is set to non-zero (thread count is tuned then unless
+ * SECAMIZ0R_NUM_THREADS is set).
+ */
+void secamiz0r_autotune(f0r_instance_t instance, int tune_threads);
+
+/**
+ * Number of threads actually used by the instance.
+ */
+unsigned int secamiz0r_get_threads(f0r_instance_t instance);
+
+/**
+ * Make every following frame filtered by the instance also come out as
+ * a proxy downscaled by factor (2, 4 or 8), for thumbnails and previews.
+ * Each proxy sample is the average of a factor x factor block of output
+ * samples, computed while the block is still in cache instead of reading
+ * the whole output again. The proxy has the same format as the output,
+ * width / factor by height / factor pixels with tightly packed rows, and
+ * the width rounded down to even for packed formats; see
+ * secamiz0r_frame_size(). NULL proxy turns it off. The buffer must stay
+ * valid while the proxy is set. Returns zero if the factor is not
+ * supported or out of memory.
+ */
+int secamiz0r_set_proxy(f0r_instance_t instance, void *proxy, unsigned int factor);
+
+/**
+ * Keep recently filtered frames in memory, up to budget bytes, and return
+ * a copy instead of filtering again when the same source frame comes with
+ * the same parameters, formats, frame index and mask (of the mixer
+ * variant); for editors scrubbing back and forth. Least recently used
+ * frames are dropped first. While the cache is on,
+ * secamiz0r_update_format(), f0r_update() and f0r_update2() derive the
+ * frame index from the time argument instead of counting calls, so the
+ * same time always gives the same frame; its parity follows the frame
+ * number at the rate set by secamiz0r_set_frame_rate(). Frames filtered
+ * with a proxy are neither cached nor taken from the cache. Zero budget
+ * (the default, unless SECAMIZ0R_CACHE_MB environment variable is set)
+ * turns it off.
+ */
+void secamiz0r_set_cache(f0r_instance_t instance, size_t budget);
+
+/**
+ * Frames per second of the time argument, used with the cache on to
+ * tell odd frames from even ones. Set it once, before any frame is
+ * cached; 25 if not set, or if frame_rate isn't above zero.
+ */
+void secamiz0r_set_frame_rate(f0r_instance_t instance, double frame_rate);
+
+/**
+ * Generate noise of the next frame on a helper thread while the current
+ * one is being filtered, so that filtering only reads it from memory.
+ * Noise depends only on the frame index, so the output is the same either
+ * way; frames which don't follow the previous one just don't benefit.
+ * Takes two frames' worth of 32-bit values per pixel pair. Pays off only
+ * with a spare core, which has yet to be measured; on a busy single CPU
+ * it's slower. Off by default, unless SECAMIZ0R_NOISE_AHEAD environment
+ * variable is set to non-zero.
+ * Returns zero if out of memory or built without thread support.
+ */
+int secamiz0r_set_noise_ahead(f0r_instance_t instance, int enabled);
+
+/**
+ * Write the timeline of recent frames, bands and pipeline stages as a JSON
+ * file for chrome://tracing or Perfetto. Events are recorded only if the
+ * library is built with SECAMIZ0R_TRACE, into a ring buffer holding the
+ * last SECAMIZ0R_TRACE_EVENTS (default 262144) of them. If environment
+ * variable SECAMIZ0R_TRACE_FILE is set, the timeline is written there
+ * when the instance is destroyed. Returns zero on failure or if tracing
+ * isn't built in.
+ */
+int secamiz0r_write_trace(f0r_instance_t instance, char const *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SECAMIZ0R_H
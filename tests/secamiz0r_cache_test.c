@@ -0,0 +1,217 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_cache_test.c: a frame taken from the cache must be the same
+ * as the frame filtered again, the cache must keep no more frames than
+ * its budget holds, dropping the least recently used first, and the same
+ * time must give the same frame whatever was filtered before it.
+ */
+
+#include "secamiz0r_test.h"
+
+#define WIDTH 720
+#define HEIGHT 40
+
+static f0r_instance_t create_cached_instance(size_t budget)
+{
+    f0r_instance_t instance = create_instance(WIDTH, HEIGHT, 1);
+
+    if (instance) {
+        secamiz0r_set_cache(instance, budget);
+    }
+
+    return instance;
+}
+
+/**
+ * Filter the frame at each of the times in turn, the last one into dst.
+ */
+static void filter_times(f0r_instance_t instance, double const *times, size_t count,
+                         uint8_t const *src, enum secamiz0r_format format, uint8_t *dst)
+{
+    for (size_t i = 0; i < count; i++) {
+        secamiz0r_update_format(instance, times[i], src, format, dst, format);
+    }
+}
+
+/**
+ * A second frame at the same time is a hit, and is the same as the frame
+ * filtered by another instance.
+ */
+static int check_hit(uint8_t const *src, enum secamiz0r_format format, size_t size)
+{
+    f0r_instance_t cached = create_cached_instance(size * 4);
+    f0r_instance_t fresh = create_cached_instance(size * 4);
+    uint8_t *first = calloc(1, size);
+    uint8_t *hit = calloc(1, size);
+    uint8_t *again = calloc(1, size);
+    int ok = 0;
+
+    if (cached && fresh && first && hit && again) {
+        secamiz0r_update_format(cached, 1.2, src, format, first, format);
+        secamiz0r_update_format(cached, 1.2, src, format, hit, format);
+        secamiz0r_update_format(fresh, 1.2, src, format, again, format);
+
+        ok = filtered_frames(cached) == 1 && !memcmp(first, hit, size) && !memcmp(again, hit, size);
+    }
+
+    report(ok, "%s, hit is the same as filtering again", format_name(format));
+
+    free(again);
+    free(hit);
+    free(first);
+
+    if (fresh) {
+        f0r_destruct(fresh);
+    }
+
+    if (cached) {
+        f0r_destruct(cached);
+    }
+
+    return ok;
+}
+
+/**
+ * With room for two frames, a third one drops the least recently used,
+ * and a budget smaller than a frame keeps nothing.
+ */
+static int check_eviction(uint8_t const *src, enum secamiz0r_format format, size_t size)
+{
+    f0r_instance_t two = create_cached_instance(size * 2 + size / 2);
+    f0r_instance_t none = create_cached_instance(size - 1);
+    uint8_t *dst = calloc(1, size);
+    int ok = 0;
+
+    if (two && none && dst) {
+        static double const warm[] = { 0.0, 0.04, 0.0, 0.08 };
+        static double const kept[] = { 0.0, 0.08 };
+        static double const dropped[] = { 0.04 };
+
+        // 0.04 is the least recently used when 0.08 comes.
+        filter_times(two, warm, COUNT_OF(warm), src, format, dst);
+        ok = filtered_frames(two) == 3;
+
+        filter_times(two, kept, COUNT_OF(kept), src, format, dst);
+        ok = ok && filtered_frames(two) == 3;
+
+        filter_times(two, dropped, COUNT_OF(dropped), src, format, dst);
+        ok = ok && filtered_frames(two) == 4;
+
+        filter_times(none, warm, COUNT_OF(warm), src, format, dst);
+        ok = ok && filtered_frames(none) == COUNT_OF(warm);
+    }
+
+    report(ok, "%s, least recently used frames dropped to fit the budget", format_name(format));
+
+    free(dst);
+
+    if (none) {
+        f0r_destruct(none);
+    }
+
+    if (two) {
+        f0r_destruct(two);
+    }
+
+    return ok;
+}
+
+/**
+ * Filter the frame at each of the times in turn with a new instance,
+ * the last one into dst.
+ */
+static int filter_history(double const *times, size_t count,
+                          uint8_t const *src, enum secamiz0r_format format, uint8_t *dst, size_t size)
+{
+    f0r_instance_t instance = create_cached_instance(size * 8);
+
+    if (!instance) {
+        return 0;
+    }
+
+    filter_times(instance, times, count, src, format, dst);
+    f0r_destruct(instance);
+
+    return 1;
+}
+
+/**
+ * The same time after different scrubbing gives the same frame, whether
+ * it was filtered or taken from the cache.
+ */
+static int check_history(uint8_t const *src, enum secamiz0r_format format, size_t size)
+{
+    // Steps between times differ from one history to another, the
+    // shortest being half a frame while scrubbing.
+    static double const playback[] = { 0.0, 0.04, 0.08, 0.12 };
+    static double const alone[] = { 0.12 };
+    static double const scrub[] = { 0.5, 0.02, 0.3, 0.1, 0.12 };
+    static double const back[] = { 0.12, 0.16, 0.2, 0.12 };
+    uint8_t *expected = calloc(1, size);
+    uint8_t *actual = calloc(1, size);
+    int ok = expected && actual && filter_history(playback, COUNT_OF(playback), src, format, expected, size)
+             && filter_history(alone, COUNT_OF(alone), src, format, actual, size)
+             && !memcmp(expected, actual, size)
+             && filter_history(scrub, COUNT_OF(scrub), src, format, actual, size)
+             && !memcmp(expected, actual, size)
+             && filter_history(back, COUNT_OF(back), src, format, actual, size)
+             && !memcmp(expected, actual, size);
+
+    report(ok, "%s, same time gives the same frame after any scrubbing", format_name(format));
+
+    free(actual);
+    free(expected);
+
+    return ok;
+}
+
+int main(void)
+{
+    static enum secamiz0r_format const formats[] = {
+        SECAMIZ0R_FORMAT_RGBA8888, SECAMIZ0R_FORMAT_UYVY,
+    };
+    int failed = 0;
+
+    f0r_init();
+
+    for (size_t f = 0; f < COUNT_OF(formats); f++) {
+        size_t const size = secamiz0r_frame_size(WIDTH, HEIGHT, formats[f]);
+        uint8_t *src = malloc(size);
+
+        if (!src) {
+            failed++;
+            continue;
+        }
+
+        fill_frame(src, size, formats[f] + 1);
+
+        failed += !check_hit(src, formats[f], size);
+        failed += !check_eviction(src, formats[f], size);
+        failed += !check_history(src, formats[f], size);
+
+        free(src);
+    }
+
+    f0r_deinit();
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
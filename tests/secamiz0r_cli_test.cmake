@@ -0,0 +1,62 @@
+# secamiz0r_cli_test.cmake: outputs of consecutive -r ranges of
+# secamiz0r-cli put together must be the same as the output of one run
+# over all frames, for raw frames read, mapped or filtered in strips,
+# and for YUV4MPEG2 streams.
+#
+#   cmake -DCLI=path/to/secamiz0r-cli -DWORK_DIR=dir [-DMMAP=ON] -P secamiz0r_cli_test.cmake
+
+set(width 64)
+set(height 16)
+set(frames 5)
+set(alphabet "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz")
+
+math(EXPR rgba_size "${width} * ${height} * 4 * ${frames}")
+string(RANDOM LENGTH ${rgba_size} ALPHABET ${alphabet} RANDOM_SEED 1 rgba)
+file(WRITE "${WORK_DIR}/cli_input.rgba" "${rgba}")
+
+# Planar 4:2:0 frames.
+math(EXPR y4m_frame_size "${width} * ${height} * 3 / 2")
+set(y4m "YUV4MPEG2 W${width} H${height} F25:1 Ip A1:1 C420jpeg\n")
+
+foreach(frame RANGE 1 ${frames})
+	string(RANDOM LENGTH ${y4m_frame_size} ALPHABET ${alphabet} RANDOM_SEED ${frame} planes)
+	set(y4m "${y4m}FRAME\n${planes}")
+endforeach()
+
+file(WRITE "${WORK_DIR}/cli_input.y4m" "${y4m}")
+
+function(run_cli output)
+	execute_process(COMMAND "${CLI}" -f 0.5 -n 0.9 ${ARGN} "${WORK_DIR}/${output}" RESULT_VARIABLE result)
+
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "secamiz0r-cli ${ARGN} ${output} failed: ${result}")
+	endif()
+endfunction()
+
+# Whole run, then ranges 0:2, 2:2 and 4 to the end, compared byte for byte.
+function(check_shards name input)
+	run_cli(${name}_full ${ARGN} "${WORK_DIR}/${input}")
+	file(READ "${WORK_DIR}/${name}_full" full HEX)
+	set(shards "")
+
+	foreach(range 0:2 2:2 4)
+		run_cli(${name}_shard ${ARGN} -r ${range} "${WORK_DIR}/${input}")
+		file(READ "${WORK_DIR}/${name}_shard" shard HEX)
+		set(shards "${shards}${shard}")
+	endforeach()
+
+	if(full STREQUAL "" OR NOT full STREQUAL shards)
+		message(FATAL_ERROR "FAIL ${name}: ranges put together differ from a single run")
+	endif()
+
+	message(STATUS "ok   ${name}")
+endfunction()
+
+check_shards(raw cli_input.rgba -s ${width}x${height})
+check_shards(strips cli_input.rgba -s ${width}x${height} -p 3)
+check_shards(y4m cli_input.y4m)
+
+if(MMAP)
+	check_shards(mapped cli_input.rgba -s ${width}x${height} -m)
+	check_shards(mapped_y4m cli_input.y4m -m)
+endif()
@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_inplace_test.c: frames filtered in place (src == dst) must be
+ * byte for byte the same as frames filtered into another buffer.
+ */
+
+#include "secamiz0r_test.h"
+
+/**
+ * Filter the same frame out of place and in place, in one call or in
+ * slices of a few row pairs, and compare.
+ */
+static int check(unsigned int width, unsigned int height, enum secamiz0r_format format,
+                 unsigned int threads, int sliced)
+{
+    size_t const size = secamiz0r_frame_size(width, height, format);
+    size_t const filtered = secamiz0r_frame_size(width, height & ~1u, format);
+    f0r_instance_t instance = create_instance(width, height, threads);
+    uint8_t *src = malloc(size);
+    uint8_t *dst = calloc(1, size);
+    uint8_t *frame = malloc(size);
+    int ok = 0;
+
+    if (instance && src && dst && frame) {
+        fill_frame(src, size, width + format);
+        memcpy(frame, src, size);
+
+        secamiz0r_update_frame(instance, 7, src, format, dst, format);
+
+        if (sliced) {
+            if (secamiz0r_begin_frame(instance, 7, frame, format, frame, format)) {
+                while (secamiz0r_resume_frame(instance, 3, 0.0) < height / 2) {
+                }
+            }
+        } else {
+            secamiz0r_update_frame(instance, 7, frame, format, frame, format);
+        }
+
+        ok = !memcmp(dst, frame, filtered);
+    }
+
+    report(ok, "%ux%u %s, %u thread(s)%s", width, height, format_name(format), threads, sliced ? ", sliced" : "");
+
+    free(frame);
+    free(dst);
+    free(src);
+
+    if (instance) {
+        f0r_destruct(instance);
+    }
+
+    return ok;
+}
+
+int main(void)
+{
+    // Narrower than two segments (one per band), and wider (segments
+    // which have to keep columns of their neighbours before filtering).
+    static unsigned int const widths[] = { 720, 9000 };
+    static unsigned int const thread_counts[] = { 1, 4 };
+    static enum secamiz0r_format const formats[] = {
+        SECAMIZ0R_FORMAT_RGBA8888, SECAMIZ0R_FORMAT_UYVY, SECAMIZ0R_FORMAT_YUY2,
+    };
+    int failed = 0;
+
+    f0r_init();
+
+    for (size_t w = 0; w < COUNT_OF(widths); w++) {
+        for (size_t f = 0; f < COUNT_OF(formats); f++) {
+            for (size_t t = 0; t < COUNT_OF(thread_counts); t++) {
+                for (int sliced = 0; sliced <= 1; sliced++) {
+                    failed += !check(widths[w], 40, formats[f], thread_counts[t], sliced);
+                }
+            }
+        }
+    }
+
+    f0r_deinit();
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_mask_test.c: where the mask is white, the mixer variant must
+ * give the same bytes as the whole frame filtered without a mask, and
+ * the source where the mask is black, wherever the mask edges are; and
+ * it must use the cache as the plugin itself does.
+ */
+
+#include "secamiz0r_test.h"
+
+#define WIDTH 1280
+#define HEIGHT 16
+
+/**
+ * Mask columns x0 to x1 - 1 of every row, and compare the output with
+ * the source and with the frame filtered as a whole.
+ */
+static int check(unsigned int threads, size_t x0, size_t x1)
+{
+    size_t const size = (size_t) WIDTH * HEIGHT * 4;
+    f0r_instance_t instance = create_instance(WIDTH, HEIGHT, threads);
+    uint8_t *src = malloc(size);
+    uint8_t *mask = calloc(1, size);
+    uint8_t *dst = calloc(1, size);
+    uint8_t *whole = calloc(1, size);
+    int ok = 0;
+
+    if (instance && src && mask && dst && whole) {
+        fill_frame(src, size, 1);
+
+        for (size_t y = 0; y < HEIGHT; y++) {
+            memset(&mask[(y * WIDTH + x0) * 4], 255, (x1 - x0) * 4);
+        }
+
+        f0r_update2(instance, 0.0, (uint32_t const *) src, (uint32_t const *) mask, NULL, (uint32_t *) dst);
+        secamiz0r_update_frame(instance, 0, src, SECAMIZ0R_FORMAT_RGBA8888, whole, SECAMIZ0R_FORMAT_RGBA8888);
+
+        ok = 1;
+
+        for (size_t y = 0; y < HEIGHT; y++) {
+            size_t const row = y * WIDTH * 4;
+
+            ok = ok && !memcmp(&dst[row], &src[row], x0 * 4)
+                    && !memcmp(&dst[row + x0 * 4], &whole[row + x0 * 4], (x1 - x0) * 4)
+                    && !memcmp(&dst[row + x1 * 4], &src[row + x1 * 4], (WIDTH - x1) * 4);
+        }
+    }
+
+    report(ok, "columns %zu to %zu, %u thread(s)", x0, x1, threads);
+
+    free(whole);
+    free(dst);
+    free(mask);
+    free(src);
+
+    if (instance) {
+        f0r_destruct(instance);
+    }
+
+    return ok;
+}
+
+/**
+ * With the cache on, frames are taken from it only for the same mask, and
+ * are numbered by time like those of f0r_update(): a mask which is white
+ * all over gives the frame f0r_update() gives at the same time.
+ */
+static int check_cache(unsigned int threads)
+{
+    size_t const size = (size_t) WIDTH * HEIGHT * 4;
+    f0r_instance_t masked = create_instance(WIDTH, HEIGHT, threads);
+    f0r_instance_t plain = create_instance(WIDTH, HEIGHT, threads);
+    uint8_t *src = malloc(size);
+    uint8_t *partial = calloc(1, size);
+    uint8_t *white = malloc(size);
+    uint8_t *first = calloc(1, size);
+    uint8_t *hit = calloc(1, size);
+    uint8_t *whole = calloc(1, size);
+    uint8_t *expected = calloc(1, size);
+    int ok = 0;
+
+    if (masked && plain && src && partial && white && first && hit && whole && expected) {
+        fill_frame(src, size, 2);
+        memset(white, 255, size);
+
+        for (size_t y = 0; y < HEIGHT; y++) {
+            memset(&partial[(y * WIDTH + 300) * 4], 255, 256 * 4);
+        }
+
+        secamiz0r_set_cache(masked, size * 4);
+        secamiz0r_set_cache(plain, size * 4);
+
+        f0r_update2(masked, 0.4, (uint32_t const *) src, (uint32_t const *) partial, NULL, (uint32_t *) first);
+        f0r_update2(masked, 0.4, (uint32_t const *) src, (uint32_t const *) white, NULL, (uint32_t *) whole);
+        f0r_update2(masked, 0.4, (uint32_t const *) src, (uint32_t const *) partial, NULL, (uint32_t *) hit);
+        f0r_update(plain, 0.4, (uint32_t const *) src, (uint32_t *) expected);
+
+        ok = filtered_frames(masked) == 2
+             && !memcmp(first, hit, size)
+             && memcmp(first, whole, size)
+             && !memcmp(whole, expected, size);
+    }
+
+    report(ok, "cache keyed by mask, frames numbered by time, %u thread(s)", threads);
+
+    free(expected);
+    free(whole);
+    free(hit);
+    free(first);
+    free(white);
+    free(partial);
+    free(src);
+
+    if (plain) {
+        f0r_destruct(plain);
+    }
+
+    if (masked) {
+        f0r_destruct(masked);
+    }
+
+    return ok;
+}
+
+int main(void)
+{
+    // Even and odd edges, near the frame edges and the middle, and
+    // spans narrower than the warm-up and tail.
+    static size_t const ranges[][2] = {
+        { 0, WIDTH }, { 300, 556 }, { 301, 556 }, { 300, 555 }, { 301, 555 },
+        { 1, 2 }, { 1023, 1026 }, { 1024, 1030 }, { 1000, 1001 }, { 1029, WIDTH - 3 }, { WIDTH - 1, WIDTH },
+    };
+    int failed = 0;
+
+    f0r_init();
+
+    for (size_t i = 0; i < COUNT_OF(ranges); i++) {
+        for (unsigned int threads = 1; threads <= 2; threads++) {
+            failed += !check(threads, ranges[i][0], ranges[i][1]);
+        }
+    }
+
+    for (unsigned int threads = 1; threads <= 2; threads++) {
+        failed += !check_cache(threads);
+    }
+
+    f0r_deinit();
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
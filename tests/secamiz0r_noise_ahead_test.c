@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_noise_ahead_test.c: frames whose noise was generated ahead on
+ * the helper thread must be byte for byte the same as frames which
+ * generate it themselves, in sequence, after seeking and in slices.
+ */
+
+#include <time.h>
+#include "secamiz0r_test.h"
+
+/**
+ * Give the helper thread time to generate the next frame, so that the
+ * frame really takes its noise from it.
+ */
+static void wait_for_helper(void)
+{
+    struct timespec const delay = { 0, 20 * 1000 * 1000 };
+
+    nanosleep(&delay, NULL);
+}
+
+static f0r_instance_t create_ahead_instance(unsigned int width, unsigned int height, unsigned int threads, int ahead)
+{
+    f0r_instance_t instance = create_instance(width, height, threads);
+
+    if (instance && !secamiz0r_set_noise_ahead(instance, ahead)) {
+        f0r_destruct(instance);
+        return NULL;
+    }
+
+    return instance;
+}
+
+static int check(unsigned int width, enum secamiz0r_format format, unsigned int threads)
+{
+    // In sequence, a seek forward, one back, and the next one in slices.
+    static size_t const frame_indices[] = { 0, 1, 2, 3, 9, 10, 4, 5 };
+    size_t const frame_count = COUNT_OF(frame_indices);
+
+    unsigned int const height = 40;
+    size_t const size = secamiz0r_frame_size(width, height, format);
+    f0r_instance_t plain = create_ahead_instance(width, height, threads, 0);
+    f0r_instance_t ahead = create_ahead_instance(width, height, threads, 1);
+    uint8_t *src = malloc(size);
+    uint8_t *expected = calloc(1, size);
+    uint8_t *actual = calloc(1, size);
+    int ok = 0;
+
+    if (plain && ahead && src && expected && actual) {
+        fill_frame(src, size, width + format);
+        ok = 1;
+
+        for (size_t i = 0; ok && i < frame_count; i++) {
+            secamiz0r_update_frame(plain, frame_indices[i], src, format, expected, format);
+
+            if (i + 1 < frame_count) {
+                secamiz0r_update_frame(ahead, frame_indices[i], src, format, actual, format);
+            } else if (secamiz0r_begin_frame(ahead, frame_indices[i], src, format, actual, format)) {
+                while (secamiz0r_resume_frame(ahead, 3, 0.0) < height / 2) {
+                }
+            }
+
+            ok = !memcmp(expected, actual, size);
+            wait_for_helper();
+        }
+    }
+
+    report(ok, "%ux%u %s, %u thread(s)", width, height, format_name(format), threads);
+
+    free(actual);
+    free(expected);
+    free(src);
+
+    if (ahead) {
+        f0r_destruct(ahead);
+    }
+
+    if (plain) {
+        f0r_destruct(plain);
+    }
+
+    return ok;
+}
+
+int main(void)
+{
+    static unsigned int const widths[] = { 720, 9000 };
+    static enum secamiz0r_format const formats[] = {
+        SECAMIZ0R_FORMAT_RGBA8888, SECAMIZ0R_FORMAT_YUY2,
+    };
+    int failed = 0;
+
+    f0r_init();
+
+    for (size_t w = 0; w < COUNT_OF(widths); w++) {
+        for (size_t f = 0; f < COUNT_OF(formats); f++) {
+            for (unsigned int threads = 1; threads <= 4; threads *= 4) {
+                failed += !check(widths[w], formats[f], threads);
+            }
+        }
+    }
+
+    f0r_deinit();
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_probes_test.c: the plugin module, built with USDT probes and
+ * the trace timeline if they are configured, must give the same bytes as
+ * the filter built into this program without them.
+ */
+
+#include <dlfcn.h>
+#include "secamiz0r_test.h"
+
+/**
+ * Entry points looked up in the module.
+ */
+struct module
+{
+    void *handle;
+    f0r_instance_t (*construct)(unsigned int width, unsigned int height);
+    void (*destruct)(f0r_instance_t instance);
+    void (*set_param_value)(f0r_instance_t instance, f0r_param_t param, int index);
+    int (*set_threads)(f0r_instance_t instance, unsigned int thread_count);
+    void (*update_frame)(f0r_instance_t instance, size_t frame_index,
+                         void const *src, enum secamiz0r_format src_format,
+                         void *dst, enum secamiz0r_format dst_format);
+};
+
+static int load_module(struct module *module, char const *path)
+{
+    module->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+
+    if (!module->handle) {
+        fprintf(stderr, "secamiz0r-probes-test: %s\n", dlerror());
+        return 0;
+    }
+
+    *(void **) &module->construct = dlsym(module->handle, "f0r_construct");
+    *(void **) &module->destruct = dlsym(module->handle, "f0r_destruct");
+    *(void **) &module->set_param_value = dlsym(module->handle, "f0r_set_param_value");
+    *(void **) &module->set_threads = dlsym(module->handle, "secamiz0r_set_threads");
+    *(void **) &module->update_frame = dlsym(module->handle, "secamiz0r_update_frame");
+
+    return module->construct && module->destruct && module->set_param_value
+        && module->set_threads && module->update_frame;
+}
+
+static int check(struct module const *module, unsigned int width, enum secamiz0r_format format, unsigned int threads)
+{
+    unsigned int const height = 40;
+    size_t const size = secamiz0r_frame_size(width, height, format);
+    f0r_instance_t built_in = create_instance(width, height, threads);
+    f0r_instance_t loaded = module->construct(width, height);
+    uint8_t *src = malloc(size);
+    uint8_t *expected = calloc(1, size);
+    uint8_t *actual = calloc(1, size);
+    int ok = 0;
+
+    if (built_in && loaded && src && expected && actual && module->set_threads(loaded, threads)) {
+        double fire;
+        double noise;
+
+        fill_frame(src, size, width + format);
+
+        // The same parameters as the filter built in.
+        f0r_get_param_value(built_in, &fire, 0);
+        f0r_get_param_value(built_in, &noise, 1);
+        module->set_param_value(loaded, &fire, 0);
+        module->set_param_value(loaded, &noise, 1);
+
+        ok = 1;
+
+        for (size_t i = 0; ok && i < 3; i++) {
+            secamiz0r_update_frame(built_in, i, src, format, expected, format);
+            module->update_frame(loaded, i, src, format, actual, format);
+            ok = !memcmp(expected, actual, size);
+        }
+    }
+
+    report(ok, "%ux%u %s, %u thread(s)", width, height, format_name(format), threads);
+
+    free(actual);
+    free(expected);
+    free(src);
+
+    if (loaded) {
+        module->destruct(loaded);
+    }
+
+    if (built_in) {
+        f0r_destruct(built_in);
+    }
+
+    return ok;
+}
+
+int main(void)
+{
+    static unsigned int const widths[] = { 720, 9000 };
+    static enum secamiz0r_format const formats[] = {
+        SECAMIZ0R_FORMAT_RGBA8888, SECAMIZ0R_FORMAT_UYVY,
+    };
+    struct module module;
+    int failed = 0;
+
+    if (!load_module(&module, SECAMIZ0R_MODULE)) {
+        fprintf(stderr, "secamiz0r-probes-test: can't load %s\n", SECAMIZ0R_MODULE);
+        return EXIT_FAILURE;
+    }
+
+    f0r_init();
+
+    for (size_t w = 0; w < COUNT_OF(widths); w++) {
+        for (size_t f = 0; f < COUNT_OF(formats); f++) {
+            for (unsigned int threads = 1; threads <= 4; threads *= 4) {
+                failed += !check(&module, widths[w], formats[f], threads);
+            }
+        }
+    }
+
+    f0r_deinit();
+    dlclose(module.handle);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_proxy_test.c: the proxy must be the output downscaled by box
+ * averaging, and the output must be the same with or without a proxy.
+ */
+
+#include "secamiz0r_test.h"
+
+/**
+ * Byte offsets of the samples of a packed pixel pair.
+ */
+struct layout
+{
+    int y0, u, y1, v;
+};
+
+static struct layout const layouts[] = {
+    { 0, 0, 0, 0 },
+    { 1, 0, 3, 2 },     // UYVY
+    { 0, 1, 2, 3 },     // YUY2
+};
+
+/**
+ * Average of a factor x factor block of output samples: every channel
+ * of an RGBA pixel, luma of a packed one. Chroma of a packed proxy pixel
+ * pair comes from as many pixel pairs of the output as a proxy pixel
+ * takes pixels.
+ */
+static void downscale(uint8_t *proxy, uint8_t const *frame, unsigned int width, enum secamiz0r_format format,
+                      size_t proxy_width, size_t proxy_height, size_t factor)
+{
+    size_t const area = factor * factor;
+
+    for (size_t py = 0; py < proxy_height; py++) {
+        for (size_t px = 0; px < proxy_width; px++) {
+            if (format == SECAMIZ0R_FORMAT_RGBA8888) {
+                for (int c = 0; c < 4; c++) {
+                    size_t sum = 0;
+
+                    for (size_t y = py * factor; y < (py + 1) * factor; y++) {
+                        for (size_t x = px * factor; x < (px + 1) * factor; x++) {
+                            sum += frame[(y * width + x) * 4 + c];
+                        }
+                    }
+
+                    proxy[(py * proxy_width + px) * 4 + c] = (uint8_t) ((sum + area / 2) / area);
+                }
+
+                continue;
+            }
+
+            struct layout const *layout = &layouts[format];
+            size_t const row = py * proxy_width * 2;
+            size_t luma = 0;
+            size_t u = 0;
+            size_t v = 0;
+
+            for (size_t y = py * factor; y < (py + 1) * factor; y++) {
+                uint8_t const *line = &frame[y * width * 2];
+
+                for (size_t x = px * factor; x < (px + 1) * factor; x++) {
+                    luma += line[(x / 2) * 4 + ((x & 1) ? layout->y1 : layout->y0)];
+                }
+
+                for (size_t m = (px / 2) * factor; m < (px / 2 + 1) * factor; m++) {
+                    u += line[m * 4 + layout->u];
+                    v += line[m * 4 + layout->v];
+                }
+            }
+
+            proxy[row + (px / 2) * 4 + ((px & 1) ? layout->y1 : layout->y0)] = (uint8_t) ((luma + area / 2) / area);
+            proxy[row + (px / 2) * 4 + layout->u] = (uint8_t) ((u + area / 2) / area);
+            proxy[row + (px / 2) * 4 + layout->v] = (uint8_t) ((v + area / 2) / area);
+        }
+    }
+}
+
+static int check(unsigned int width, enum secamiz0r_format src_format, enum secamiz0r_format dst_format,
+                 unsigned int factor, unsigned int threads)
+{
+    unsigned int const height = 44;
+    size_t const proxy_height = height / factor;
+    size_t const proxy_width = (dst_format == SECAMIZ0R_FORMAT_RGBA8888) ? (width / factor) : ((width / factor) & ~(size_t) 1);
+    size_t const src_size = secamiz0r_frame_size(width, height, src_format);
+    size_t const dst_size = secamiz0r_frame_size(width, height, dst_format);
+    size_t const proxy_size = secamiz0r_frame_size((unsigned int) proxy_width, (unsigned int) proxy_height, dst_format);
+    f0r_instance_t instance = create_instance(width, height, threads);
+    uint8_t *src = malloc(src_size);
+    uint8_t *plain = calloc(1, dst_size);
+    uint8_t *dst = calloc(1, dst_size);
+    uint8_t *proxy = calloc(1, proxy_size);
+    uint8_t *expected = calloc(1, proxy_size);
+    int ok = 0;
+
+    if (instance && src && plain && dst && proxy && expected) {
+        fill_frame(src, src_size, width + factor);
+
+        secamiz0r_update_frame(instance, 3, src, src_format, plain, dst_format);
+
+        if (secamiz0r_set_proxy(instance, proxy, factor)) {
+            secamiz0r_update_frame(instance, 3, src, src_format, dst, dst_format);
+            downscale(expected, dst, width, dst_format, proxy_width, proxy_height, factor);
+
+            ok = !memcmp(plain, dst, dst_size) && !memcmp(expected, proxy, proxy_size);
+        }
+    }
+
+    report(ok, "%ux%u %s to %s, 1/%u, %u thread(s)", width, height,
+           format_name(src_format), format_name(dst_format), factor, threads);
+
+    free(expected);
+    free(proxy);
+    free(dst);
+    free(plain);
+    free(src);
+
+    if (instance) {
+        f0r_destruct(instance);
+    }
+
+    return ok;
+}
+
+int main(void)
+{
+    static unsigned int const widths[] = { 720, 9000 };
+    static unsigned int const factors[] = { 2, 4, 8 };
+    static enum secamiz0r_format const formats[][2] = {
+        { SECAMIZ0R_FORMAT_RGBA8888, SECAMIZ0R_FORMAT_RGBA8888 },
+        { SECAMIZ0R_FORMAT_UYVY, SECAMIZ0R_FORMAT_UYVY },
+        { SECAMIZ0R_FORMAT_RGBA8888, SECAMIZ0R_FORMAT_YUY2 },
+    };
+    int failed = 0;
+
+    f0r_init();
+
+    for (size_t w = 0; w < COUNT_OF(widths); w++) {
+        for (size_t f = 0; f < COUNT_OF(formats); f++) {
+            for (size_t k = 0; k < COUNT_OF(factors); k++) {
+                for (unsigned int threads = 1; threads <= 4; threads *= 4) {
+                    failed += !check(widths[w], formats[f][0], formats[f][1], factors[k], threads);
+                }
+            }
+        }
+    }
+
+    f0r_deinit();
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
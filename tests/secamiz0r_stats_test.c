@@ -0,0 +1,140 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_stats_test.c: the statistics parameter must count the frames
+ * filtered, and report mean and p99 latency and fractions which agree
+ * with each other and with the time the frames took.
+ */
+
+#include <time.h>
+#include "secamiz0r_test.h"
+
+/**
+ * Values of the statistics parameter.
+ */
+struct stats
+{
+    unsigned long long frames;
+    double mean_ms;
+    double p99_ms;
+    double ignited;
+    double saturated;
+};
+
+/**
+ * Returns zero unless the whole string is in the documented form.
+ */
+static int read_stats(f0r_instance_t instance, struct stats *stats)
+{
+    f0r_param_string text = NULL;
+    int length = -1;
+
+    f0r_get_param_value(instance, &text, 2);
+
+    return text
+        && sscanf(text, "frames=%llu mean_ms=%lf p99_ms=%lf ignited=%lf saturated=%lf%n",
+                  &stats->frames, &stats->mean_ms, &stats->p99_ms, &stats->ignited, &stats->saturated, &length) == 5
+        && length == (int) strlen(text);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return (double) ts.tv_sec * 1e3 + (double) ts.tv_nsec / 1e6;
+}
+
+/**
+ * Filter a number of frames and check what is reported. With no more
+ * than a hundred frames, p99 is the slowest one, so it can't be below
+ * the mean; no latency can be above the time all frames took.
+ */
+static int check(unsigned int width, unsigned int height, unsigned int threads, size_t frames, struct stats *after)
+{
+    size_t const size = secamiz0r_frame_size(width, height, SECAMIZ0R_FORMAT_RGBA8888);
+    f0r_instance_t instance = create_instance(width, height, threads);
+    uint8_t *src = malloc(size);
+    uint8_t *dst = calloc(1, size);
+    struct stats before;
+    int ok = 0;
+
+    if (instance && src && dst) {
+        fill_frame(src, size, width);
+
+        ok = read_stats(instance, &before) && before.frames == 0
+             && before.mean_ms == 0.0 && before.p99_ms == 0.0;
+
+        double const start = now_ms();
+
+        for (size_t i = 0; i < frames; i++) {
+            f0r_update(instance, (double) i / 25.0, (uint32_t const *) src, (uint32_t *) dst);
+        }
+
+        double const elapsed = now_ms() - start;
+
+        // Values are printed with three decimals.
+        ok = ok && read_stats(instance, after)
+             && after->frames == frames
+             && after->mean_ms > 0.0
+             && after->mean_ms * frames <= elapsed + 0.0005 * frames
+             && after->p99_ms >= after->mean_ms
+             && after->p99_ms <= elapsed + 0.0005
+             && after->ignited >= 0.0 && after->ignited <= 1.0
+             && after->saturated >= 0.0 && after->saturated <= 1.0;
+    }
+
+    report(ok, "%ux%u, %u thread(s), %zu frames", width, height, threads, frames);
+
+    free(dst);
+    free(src);
+
+    if (instance) {
+        f0r_destruct(instance);
+    }
+
+    return ok;
+}
+
+int main(void)
+{
+    static size_t const frame_counts[] = { 1, 5, 100 };
+    int failed = 0;
+
+    f0r_init();
+
+    for (size_t n = 0; n < COUNT_OF(frame_counts); n++) {
+        struct stats single = { 0 };
+        struct stats split = { 0 };
+
+        failed += !check(720, 40, 1, frame_counts[n], &single);
+        failed += !check(720, 40, 4, frame_counts[n], &split);
+
+        // The same pixels are counted whichever thread filters them.
+        failed += !report(single.ignited == split.ignited && single.saturated == split.saturated,
+                          "%zu frames, the same fractions on 1 and 4 threads", frame_counts[n]);
+    }
+
+    f0r_deinit();
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_strips_test.c: a frame filtered strip by strip, with an
+ * instance as high as a strip, must be byte for byte the same as the
+ * whole frame filtered at once, including a shorter last strip.
+ */
+
+#include "secamiz0r_test.h"
+
+/**
+ * Filter the frame in strips of strip_pairs row pairs, the last one
+ * taking whatever is left.
+ */
+static int filter_strips(f0r_instance_t instance, size_t frame_index, size_t strip_pairs,
+                         uint8_t const *src, enum secamiz0r_format src_format, size_t src_pair_size,
+                         uint8_t *dst, enum secamiz0r_format dst_format, size_t dst_pair_size,
+                         size_t frame_pairs)
+{
+    for (size_t first = 0; first < frame_pairs; first += strip_pairs) {
+        size_t const pairs = (frame_pairs - first < strip_pairs) ? (frame_pairs - first) : strip_pairs;
+
+        if (!secamiz0r_update_strip(instance, frame_index, first, pairs,
+                                    &src[first * src_pair_size], src_format,
+                                    &dst[first * dst_pair_size], dst_format)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int check(unsigned int width, enum secamiz0r_format src_format, enum secamiz0r_format dst_format,
+                 unsigned int threads)
+{
+    static size_t const frame_indices[] = { 0, 1, 7 };
+    unsigned int const height = 46;
+    unsigned int const strip_height = 10;
+    size_t const src_size = secamiz0r_frame_size(width, height, src_format);
+    size_t const dst_size = secamiz0r_frame_size(width, height, dst_format);
+    f0r_instance_t whole = create_instance(width, height, threads);
+    f0r_instance_t strip = create_instance(width, strip_height, threads);
+    uint8_t *src = malloc(src_size);
+    uint8_t *expected = calloc(1, dst_size);
+    uint8_t *actual = calloc(1, dst_size);
+    int ok = 0;
+
+    if (whole && strip && src && expected && actual) {
+        fill_frame(src, src_size, width + src_format);
+        ok = 1;
+
+        for (size_t i = 0; ok && i < COUNT_OF(frame_indices); i++) {
+            secamiz0r_update_frame(whole, frame_indices[i], src, src_format, expected, dst_format);
+            memset(actual, 0, dst_size);
+
+            ok = filter_strips(strip, frame_indices[i], strip_height / 2,
+                               src, src_format, src_size / (height / 2),
+                               actual, dst_format, dst_size / (height / 2), height / 2)
+                 && !memcmp(expected, actual, dst_size);
+        }
+
+        // A strip higher than the instance must be refused.
+        ok = ok && !secamiz0r_update_strip(strip, 0, 0, strip_height / 2 + 1, src, src_format, actual, dst_format);
+    }
+
+    report(ok, "%ux%u in %u-row strips, %s to %s, %u thread(s)", width, height, strip_height,
+           format_name(src_format), format_name(dst_format), threads);
+
+    free(actual);
+    free(expected);
+    free(src);
+
+    if (strip) {
+        f0r_destruct(strip);
+    }
+
+    if (whole) {
+        f0r_destruct(whole);
+    }
+
+    return ok;
+}
+
+int main(void)
+{
+    static unsigned int const widths[] = { 720, 9000 };
+    static enum secamiz0r_format const formats[][2] = {
+        { SECAMIZ0R_FORMAT_RGBA8888, SECAMIZ0R_FORMAT_RGBA8888 },
+        { SECAMIZ0R_FORMAT_UYVY, SECAMIZ0R_FORMAT_UYVY },
+        { SECAMIZ0R_FORMAT_RGBA8888, SECAMIZ0R_FORMAT_YUY2 },
+        { SECAMIZ0R_FORMAT_YUY2, SECAMIZ0R_FORMAT_RGBA8888 },
+    };
+    int failed = 0;
+
+    f0r_init();
+
+    for (size_t w = 0; w < COUNT_OF(widths); w++) {
+        for (size_t f = 0; f < COUNT_OF(formats); f++) {
+            for (unsigned int threads = 1; threads <= 4; threads *= 4) {
+                failed += !check(widths[w], formats[f][0], formats[f][1], threads);
+            }
+        }
+    }
+
+    f0r_deinit();
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
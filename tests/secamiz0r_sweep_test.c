@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_sweep_test.c: every output of a parameter sweep must be byte
+ * for byte the same as the frame filtered on its own with those
+ * parameters, and the parameters of the instance must stay as they were.
+ */
+
+#include "secamiz0r_test.h"
+
+static struct secamiz0r_params const sweep[] = {
+    { 0.0, 0.0 }, { 0.125, 0.125 }, { 0.5, 0.9 }, { 1.0, 0.0 }, { 0.0, 1.0 }, { 1.0, 1.0 },
+};
+
+static int check(unsigned int width, unsigned int threads)
+{
+    unsigned int const height = 40;
+    size_t const size = secamiz0r_frame_size(width, height, SECAMIZ0R_FORMAT_RGBA8888);
+    f0r_instance_t instance = create_instance(width, height, threads);
+    uint8_t *src = malloc(size);
+    uint8_t *expected = calloc(1, size);
+    uint8_t *outputs = calloc(COUNT_OF(sweep), size);
+    uint32_t *dst[COUNT_OF(sweep)];
+    int ok = 0;
+
+    if (instance && src && expected && outputs) {
+        double fire;
+        double noise;
+
+        fill_frame(src, size, width);
+
+        for (size_t i = 0; i < COUNT_OF(sweep); i++) {
+            dst[i] = (uint32_t *) &outputs[i * size];
+        }
+
+        f0r_get_param_value(instance, &fire, 0);
+        f0r_get_param_value(instance, &noise, 1);
+
+        ok = secamiz0r_update_sweep(instance, 5, (uint32_t const *) src, sweep, dst, COUNT_OF(sweep));
+
+        for (size_t i = 0; ok && i < COUNT_OF(sweep); i++) {
+            double sweep_fire;
+            double sweep_noise;
+
+            // The instance must still have its own parameters.
+            f0r_get_param_value(instance, &sweep_fire, 0);
+            f0r_get_param_value(instance, &sweep_noise, 1);
+            ok = sweep_fire == fire && sweep_noise == noise;
+
+            sweep_fire = sweep[i].fire_intensity;
+            sweep_noise = sweep[i].noise_intensity;
+            f0r_set_param_value(instance, &sweep_fire, 0);
+            f0r_set_param_value(instance, &sweep_noise, 1);
+
+            secamiz0r_update_frame(instance, 5, src, SECAMIZ0R_FORMAT_RGBA8888, expected, SECAMIZ0R_FORMAT_RGBA8888);
+            ok = ok && !memcmp(expected, dst[i], size);
+
+            f0r_set_param_value(instance, &fire, 0);
+            f0r_set_param_value(instance, &noise, 1);
+        }
+    }
+
+    report(ok, "%ux%u, %zu parameter sets, %u thread(s)", width, height, COUNT_OF(sweep), threads);
+
+    free(outputs);
+    free(expected);
+    free(src);
+
+    if (instance) {
+        f0r_destruct(instance);
+    }
+
+    return ok;
+}
+
+int main(void)
+{
+    static unsigned int const widths[] = { 720, 9000 };
+    int failed = 0;
+
+    f0r_init();
+
+    for (size_t w = 0; w < COUNT_OF(widths); w++) {
+        for (unsigned int threads = 1; threads <= 4; threads *= 4) {
+            failed += !check(widths[w], threads);
+        }
+    }
+
+    f0r_deinit();
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
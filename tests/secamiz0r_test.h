@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_test.h: fixtures shared by the tests.
+ */
+
+#ifndef SECAMIZ0R_TEST_H
+#define SECAMIZ0R_TEST_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "secamiz0r.h"
+
+#define COUNT_OF(array) (sizeof(array) / sizeof((array)[0]))
+
+/**
+ * Noise rather than a picture: every column differs from its neighbours,
+ * so anything read from the wrong place shows up.
+ */
+static inline void fill_frame(uint8_t *frame, size_t size, uint32_t seed)
+{
+    uint32_t x = seed * 2654435761u + 1;
+
+    for (size_t i = 0; i < size; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        frame[i] = (uint8_t) (x >> 24);
+    }
+}
+
+static inline char const *format_name(enum secamiz0r_format format)
+{
+    static char const *const names[] = { "RGBA", "UYVY", "YUY2" };
+
+    return names[format];
+}
+
+/**
+ * Instance filtering with the given number of threads. Strong noise
+ * makes lines shift both ways, so edges of bands and segments get the
+ * worst of it.
+ */
+static inline f0r_instance_t create_instance(unsigned int width, unsigned int height, unsigned int threads)
+{
+    f0r_instance_t instance = f0r_construct(width, height);
+    double fire = 0.5;
+    double noise = 0.9;
+
+    if (!instance) {
+        return NULL;
+    }
+
+    if (!secamiz0r_set_threads(instance, threads)) {
+        f0r_destruct(instance);
+        return NULL;
+    }
+
+    f0r_set_param_value(instance, &fire, 0);
+    f0r_set_param_value(instance, &noise, 1);
+
+    return instance;
+}
+
+/**
+ * Number of frames really filtered, as reported by the statistics
+ * parameter; frames taken from the cache don't count.
+ */
+static inline unsigned long long filtered_frames(f0r_instance_t instance)
+{
+    f0r_param_string stats = NULL;
+    unsigned long long frames = 0;
+
+    f0r_get_param_value(instance, &stats, 2);
+
+    if (!stats || sscanf(stats, "frames=%llu", &frames) != 1) {
+        return 0;
+    }
+
+    return frames;
+}
+
+/**
+ * Print the outcome of a check, followed by its description.
+ * Returns ok, for counting failures.
+ */
+static inline int report(int ok, char const *format, ...)
+{
+    va_list args;
+
+    fputs(ok ? "ok   " : "FAIL ", stdout);
+
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+
+    putchar('\n');
+
+    return ok;
+}
+
+#endif // SECAMIZ0R_TEST_H
@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_threads_test.c: frames split between threads, in bands and
+ * in segments of very wide rows, must be byte for byte the same as frames
+ * filtered on one thread.
+ */
+
+#include "secamiz0r_test.h"
+
+/**
+ * Filter a few frames with the given number of threads.
+ */
+static int filter(uint8_t *dst, uint8_t const *src, unsigned int width, unsigned int height,
+                  enum secamiz0r_format src_format, enum secamiz0r_format dst_format,
+                  unsigned int threads, size_t frames)
+{
+    size_t const dst_size = secamiz0r_frame_size(width, height, dst_format);
+    f0r_instance_t instance = create_instance(width, height, threads);
+
+    if (!instance) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < frames; i++) {
+        secamiz0r_update_frame(instance, i, src, src_format, &dst[i * dst_size], dst_format);
+    }
+
+    f0r_destruct(instance);
+
+    return 1;
+}
+
+static int check(unsigned int width, enum secamiz0r_format src_format, enum secamiz0r_format dst_format)
+{
+    static unsigned int const thread_counts[] = { 2, 3, 4 };
+    unsigned int const height = 40;
+    size_t const frames = 2;
+    size_t const src_size = secamiz0r_frame_size(width, height, src_format);
+    size_t const dst_size = secamiz0r_frame_size(width, height, dst_format);
+    uint8_t *src = malloc(src_size);
+    uint8_t *single = calloc(frames, dst_size);
+    uint8_t *split = calloc(frames, dst_size);
+    int ready = src && single && split;
+    int ok = 1;
+
+    if (ready) {
+        fill_frame(src, src_size, width + src_format);
+        ready = filter(single, src, width, height, src_format, dst_format, 1, frames);
+    }
+
+    for (size_t t = 0; t < COUNT_OF(thread_counts); t++) {
+        int const same = ready && filter(split, src, width, height, src_format, dst_format, thread_counts[t], frames)
+                         && !memcmp(single, split, frames * dst_size);
+
+        ok = report(same, "%ux%u %s to %s, %u threads", width, height,
+                    format_name(src_format), format_name(dst_format), thread_counts[t]) && ok;
+    }
+
+    free(split);
+    free(single);
+    free(src);
+
+    return ok;
+}
+
+int main(void)
+{
+    // One segment per band, and segments (including a narrow last one).
+    static unsigned int const widths[] = { 720, 9000 };
+    static enum secamiz0r_format const formats[][2] = {
+        { SECAMIZ0R_FORMAT_RGBA8888, SECAMIZ0R_FORMAT_RGBA8888 },
+        { SECAMIZ0R_FORMAT_UYVY, SECAMIZ0R_FORMAT_UYVY },
+        { SECAMIZ0R_FORMAT_RGBA8888, SECAMIZ0R_FORMAT_YUY2 },
+        { SECAMIZ0R_FORMAT_YUY2, SECAMIZ0R_FORMAT_RGBA8888 },
+    };
+    int failed = 0;
+
+    f0r_init();
+
+    for (size_t w = 0; w < COUNT_OF(widths); w++) {
+        for (size_t f = 0; f < COUNT_OF(formats); f++) {
+            failed += !check(widths[w], formats[f][0], formats[f][1]);
+        }
+    }
+
+    f0r_deinit();
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
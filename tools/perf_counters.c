@@ -0,0 +1,154 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * perf_counters.c: hardware performance counters for benchmarks (Linux only).
+ */
+
+#include <string.h>
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Event type and config for each counter.
+ */
+static struct
+{
+    uint32_t type;
+    uint64_t config;
+} const events[PERF_COUNTER_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                          | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                          | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16) },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                          | (PERF_COUNT_HW_CACHE_OP_WRITE << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16) },
+};
+#endif
+
+static char const *const names[PERF_COUNTER_COUNT] = {
+    "cycles",
+    "instructions",
+    "L1d-misses",
+    "LLC-misses",
+    "branch-misses",
+    "L1d-loads",
+    "L1d-stores",
+};
+
+int perf_counters_open(struct perf_counters *counters)
+{
+    int opened = 0;
+
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        counters->fds[i] = -1;
+
+#ifdef __linux__
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        counters->fds[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+        if (counters->fds[i] != -1) {
+            opened++;
+        }
+#endif
+    }
+
+    return opened;
+}
+
+char const *perf_counter_name(enum perf_counter counter)
+{
+    return names[counter];
+}
+
+int perf_counter_available(struct perf_counters const *counters, enum perf_counter counter)
+{
+    return counters->fds[counter] != -1;
+}
+
+void perf_counters_start(struct perf_counters *counters)
+{
+#ifdef __linux__
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (counters->fds[i] != -1) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void perf_counters_stop(struct perf_counters *counters, uint64_t *values)
+{
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        values[i] = 0;
+
+#ifdef __linux__
+        if (counters->fds[i] == -1) {
+            continue;
+        }
+
+        ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        // value, time enabled, time running
+        uint64_t data[3];
+
+        if (read(counters->fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+            continue;
+        }
+
+        values[i] = (data[2] < data[1]) ? (uint64_t) ((double) data[0] * data[1] / data[2]) : data[0];
+#endif
+    }
+}
+
+void perf_counters_close(struct perf_counters *counters)
+{
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+#ifdef __linux__
+        if (counters->fds[i] != -1) {
+            close(counters->fds[i]);
+        }
+#endif
+        counters->fds[i] = -1;
+    }
+}
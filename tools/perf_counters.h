@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * perf_counters.h: hardware performance counters for benchmarks (Linux only).
+ */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+
+/**
+ * Counted events. Any of them may be unavailable: in virtual machines,
+ * with strict perf_event_paranoid, or on other platforms.
+ */
+enum perf_counter
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_LOADS,
+    PERF_L1D_STORES,
+    PERF_COUNTER_COUNT,
+};
+
+struct perf_counters
+{
+    int fds[PERF_COUNTER_COUNT];
+};
+
+/**
+ * Open counters for the calling thread, user space only.
+ * Returns number of counters which could be opened.
+ */
+int perf_counters_open(struct perf_counters *counters);
+
+/**
+ * Name of the counter, for error messages and reports.
+ */
+char const *perf_counter_name(enum perf_counter counter);
+
+/**
+ * Check if the counter has been opened.
+ */
+int perf_counter_available(struct perf_counters const *counters, enum perf_counter counter);
+
+/**
+ * Reset and enable all opened counters.
+ */
+void perf_counters_start(struct perf_counters *counters);
+
+/**
+ * Disable counters and read their values, scaled if the kernel had
+ * to multiplex them. Unavailable counters read as zero.
+ */
+void perf_counters_stop(struct perf_counters *counters, uint64_t *values);
+
+void perf_counters_close(struct perf_counters *counters);
+
+#endif // PERF_COUNTERS_H
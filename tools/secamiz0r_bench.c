@@ -0,0 +1,332 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_bench.c: whole-frame benchmarks of f0r_update().
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "secamiz0r.h"
+
+/**
+ * Command line options.
+ */
+struct options
+{
+    char const *mode;
+    unsigned int width;
+    unsigned int height;
+    size_t frames;
+    unsigned int max_instances;
+    int noise_ahead;
+};
+
+/**
+ * One instance driven by its own thread in "scale" mode.
+ */
+struct runner
+{
+    pthread_t thread;
+    f0r_instance_t instance;
+    uint32_t *src;
+    uint32_t *dst;
+    size_t frames;
+    double *latencies;
+};
+
+/**
+ * All runners wait for the same signal, so that they start together.
+ */
+static pthread_mutex_t start_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static int started;
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+        "usage: secamiz0r-bench MODE [options]\n"
+        "modes:\n"
+        "  scale      run 1, 2, 4... instances on as many threads at once\n"
+        "options:\n"
+        "  -s WxH     frame size (default: 1920x1080)\n"
+        "  -n N       frames per instance (default: 50)\n"
+        "  -j N       maximum number of instances (default: number of CPUs)\n"
+        "  -a B       generate noise of the next frame on a helper thread\n"
+        "             in every instance: 0, 1 (default: 0)\n");
+}
+
+static int parse_options(struct options *options, int argc, char **argv)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    options->mode = NULL;
+    options->width = 1920;
+    options->height = 1080;
+    options->frames = 50;
+    options->max_instances = (cpus > 0) ? (unsigned int) cpus : 1;
+    options->noise_ahead = 0;
+
+    for (int i = 1; i < argc; i++) {
+        char const *arg = argv[i];
+
+        if (arg[0] != '-') {
+            if (options->mode) {
+                return 0;
+            }
+
+            options->mode = arg;
+            continue;
+        }
+
+        if (!arg[1] || arg[2] || i + 1 >= argc) {
+            return 0;
+        }
+
+        char const *value = argv[++i];
+
+        switch (arg[1]) {
+        case 's':
+            if (sscanf(value, "%ux%u", &options->width, &options->height) != 2) {
+                return 0;
+            }
+            break;
+        case 'n':
+            options->frames = (size_t) strtoul(value, NULL, 10);
+            break;
+        case 'j':
+            options->max_instances = (unsigned int) atoi(value);
+            break;
+        case 'a':
+            options->noise_ahead = atoi(value) != 0;
+            break;
+        default:
+            return 0;
+        }
+    }
+
+    return options->mode && options->width > 0 && options->height > 0
+        && options->frames > 0 && options->max_instances > 0;
+}
+
+/**
+ * Monotonic time in seconds.
+ */
+static double get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/**
+ * Something which looks a bit like a picture: gradients with sharp edges,
+ * so that the filter has both flat areas and fire-triggering transitions.
+ */
+static void fill_frame(uint32_t *frame, unsigned int width, unsigned int height, unsigned int seed)
+{
+    for (unsigned int y = 0; y < height; y++) {
+        for (unsigned int x = 0; x < width; x++) {
+            uint8_t *pixel = (uint8_t *) &frame[y * width + x];
+            unsigned int band = ((x + seed) / 64 + y / 48) % 4;
+
+            pixel[0] = (uint8_t) ((x * 255) / width);
+            pixel[1] = (uint8_t) ((y * 255) / height);
+            pixel[2] = (uint8_t) (band * 85);
+            pixel[3] = 255;
+        }
+    }
+}
+
+static int compare_doubles(void const *a, void const *b)
+{
+    double x = *(double const *) a;
+    double y = *(double const *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void *runner_main(void *arg)
+{
+    struct runner *runner = arg;
+
+    pthread_mutex_lock(&start_mutex);
+
+    while (!started) {
+        pthread_cond_wait(&start_cond, &start_mutex);
+    }
+
+    pthread_mutex_unlock(&start_mutex);
+
+    for (size_t i = 0; i < runner->frames; i++) {
+        double t0 = get_time();
+        f0r_update(runner->instance, (double) i, runner->src, runner->dst);
+        runner->latencies[i] = get_time() - t0;
+    }
+
+    return NULL;
+}
+
+/**
+ * Run n instances simultaneously, each on its own thread with its own
+ * frames, and report aggregate throughput and per-call latency.
+ */
+static int run_scale_step(struct options const *options, unsigned int n, double *single_fps)
+{
+    size_t const pixels = (size_t) options->width * options->height;
+    struct runner *runners = calloc(n, sizeof(*runners));
+    double *latencies = malloc(sizeof(*latencies) * n * options->frames);
+
+    if (!runners || !latencies) {
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+        struct runner *runner = &runners[i];
+
+        runner->instance = f0r_construct(options->width, options->height);
+        runner->src = malloc(pixels * 4);
+        runner->dst = malloc(pixels * 4);
+        runner->frames = options->frames;
+        runner->latencies = &latencies[i * options->frames];
+
+        if (!runner->instance || !runner->src || !runner->dst) {
+            return 0;
+        }
+
+        // One thread per instance, whatever the autotuner thinks.
+        secamiz0r_set_threads(runner->instance, 1);
+
+        if (!secamiz0r_set_noise_ahead(runner->instance, options->noise_ahead)) {
+            return 0;
+        }
+
+        fill_frame(runner->src, options->width, options->height, i);
+    }
+
+    started = 0;
+
+    for (unsigned int i = 0; i < n; i++) {
+        if (pthread_create(&runners[i].thread, NULL, runner_main, &runners[i]) != 0) {
+            return 0;
+        }
+    }
+
+    pthread_mutex_lock(&start_mutex);
+    started = 1;
+    double t0 = get_time();
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&start_mutex);
+
+    for (unsigned int i = 0; i < n; i++) {
+        pthread_join(runners[i].thread, NULL);
+    }
+
+    double elapsed = get_time() - t0;
+
+    size_t const count = n * options->frames;
+    double total = 0.0;
+
+    for (size_t i = 0; i < count; i++) {
+        total += latencies[i];
+    }
+
+    qsort(latencies, count, sizeof(*latencies), compare_doubles);
+
+    double const fps = count / elapsed;
+
+    if (n == 1) {
+        *single_fps = fps;
+    }
+
+    printf("%9u %10.2f %10.1f %9.3f %9.3f %9.3f %9.3f %7.0f%%\n",
+           n, fps, fps * pixels / 1e6,
+           1e3 * total / count,
+           1e3 * latencies[count / 2],
+           1e3 * latencies[(count * 99) / 100],
+           1e3 * latencies[count - 1],
+           100.0 * fps / (*single_fps * n));
+
+    for (unsigned int i = 0; i < n; i++) {
+        f0r_destruct(runners[i].instance);
+        free(runners[i].src);
+        free(runners[i].dst);
+    }
+
+    free(latencies);
+    free(runners);
+
+    return 1;
+}
+
+/**
+ * "scale" mode: how independent instances scale within one process.
+ * Efficiency is aggregate throughput relative to n times a single instance.
+ */
+static int run_scale(struct options const *options)
+{
+    double single_fps = 0.0;
+
+    printf("# %ux%u, %zu frames per instance%s\n", options->width, options->height, options->frames,
+           options->noise_ahead ? ", noise generated ahead" : "");
+    printf("%9s %10s %10s %9s %9s %9s %9s %8s\n",
+           "instances", "frames/s", "Mpixel/s", "mean ms", "p50 ms", "p99 ms", "max ms", "effic.");
+
+    unsigned int n = 1;
+
+    while (1) {
+        if (!run_scale_step(options, n, &single_fps)) {
+            fprintf(stderr, "secamiz0r-bench: failed to set up %u instances\n", n);
+            return 0;
+        }
+
+        if (n == options->max_instances) {
+            break;
+        }
+
+        // Powers of two, and the maximum itself in the end.
+        n = (n * 2 < options->max_instances) ? (n * 2) : options->max_instances;
+    }
+
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    struct options options;
+
+    if (!parse_options(&options, argc, argv)) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    if (!strcmp(options.mode, "scale")) {
+        return run_scale(&options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    print_usage();
+    return EXIT_FAILURE;
+}
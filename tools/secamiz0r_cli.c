@@ -0,0 +1,1262 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_cli.c: apply secamiz0r to raw video frames without a frei0r host.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "secamiz0r.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef SECAMIZ0R_THREADS
+#include <pthread.h>
+#endif
+
+/**
+ * Number of output buffers recycled between the filter and the writer.
+ */
+#define OUTPUT_POOL_SIZE 4
+
+/**
+ * How many frames ahead of the current one the kernel is asked to read
+ * in mmap mode.
+ */
+#define READAHEAD_FRAMES 4
+
+/**
+ * Row pairs per strip when PAM images are filtered without -p.
+ */
+#define DEFAULT_STRIP_PAIRS 128
+
+/**
+ * Chroma subsampling of planar YUV4MPEG2 frames, as shifts of the frame
+ * size: 1 and 1 for 4:2:0, 1 and 0 for 4:2:2, 0 and 0 for 4:4:4.
+ */
+struct y4m_chroma
+{
+    unsigned int x_shift;
+    unsigned int y_shift;
+};
+
+/**
+ * Command line options.
+ */
+struct options
+{
+    unsigned int width;
+    unsigned int height;
+    enum secamiz0r_format input_format;
+    enum secamiz0r_format output_format;
+    int set_formats;
+    double fire_intensity;
+    double noise_intensity;
+    int use_mmap;
+    unsigned int thread_count;
+    int set_thread_count;
+    size_t first_frame;
+    size_t frame_count;
+    size_t strip_pairs;
+    char const *input_path;
+    char const *output_path;
+};
+
+/**
+ * Source of frames: either a stream read into a buffer, or a mapped file
+ * which frames are read from directly. Raw frames, planar YUV4MPEG2
+ * stream, or a single PAM image.
+ */
+struct input
+{
+    FILE *file;
+    uint8_t *buffer;
+    size_t buffered;
+
+    uint8_t const *map;
+    size_t map_size;
+    size_t offset;
+
+    int y4m;
+    struct y4m_chroma chroma;
+    int pam;
+    char header[256];
+
+    // Set when the input ends in the middle of a frame.
+    int truncated;
+};
+
+/**
+ * Destination of frames. Filtered frames are put into a small pool of
+ * buffers, which are written out and recycled by a separate thread
+ * when threads are available.
+ */
+struct output
+{
+    FILE *file;
+    int y4m;
+    size_t frame_size;
+    uint8_t *pool[OUTPUT_POOL_SIZE];
+    size_t filled;
+    size_t written;
+    int failed;
+
+#ifdef SECAMIZ0R_THREADS
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int done;
+#endif
+};
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+        "usage: secamiz0r-cli [options] INPUT OUTPUT\n"
+        "  -s WxH     frame size (required for raw input)\n"
+        "  -i FORMAT  input pixel format: rgba, uyvy, yuy2 (default: rgba)\n"
+        "  -o FORMAT  output pixel format (default: same as input)\n"
+        "  -f VALUE   fire intensity (default: 0.125)\n"
+        "  -n VALUE   noise intensity (default: 0.125)\n"
+        "  -m         map input file into memory instead of reading it\n"
+        "  -t N       number of threads, 0 means one per CPU\n"
+        "             (default: SECAMIZ0R_NUM_THREADS, or as tuned with\n"
+        "             SECAMIZ0R_AUTOTUNE=1, or 1)\n"
+        "  -r N[:M]   render only M frames starting from frame N (default: all)\n"
+        "  -p N       read, filter and write frames in strips of N row pairs,\n"
+        "             so that whole frames are never in memory\n"
+        "INPUT is a raw frame file in the input pixel format, a YUV4MPEG2\n"
+        "stream of planar 4:2:0, 4:2:2 or 4:4:4 frames (filtered as UYVY, so\n"
+        "-i, -o and -p don't apply), or an RGBA PAM image, which is always\n"
+        "filtered in strips (of %d row pairs unless -p is given).\n"
+        "OUTPUT is written in the same container and colorspace.\n"
+        "A frame cut short at the end is an error.\n"
+        "\"-\" means stdin/stdout.\n"
+        "Every frame looks the same regardless of the range it is rendered in,\n"
+        "so outputs of consecutive ranges can be concatenated. YUV4MPEG2 header\n"
+        "is written only by the range which starts from frame 0.\n",
+        DEFAULT_STRIP_PAIRS);
+}
+
+/**
+ * Pixel format from its name.
+ */
+static int parse_format(enum secamiz0r_format *format, char const *name)
+{
+    if (!strcmp(name, "rgba")) {
+        *format = SECAMIZ0R_FORMAT_RGBA8888;
+    } else if (!strcmp(name, "uyvy")) {
+        *format = SECAMIZ0R_FORMAT_UYVY;
+    } else if (!strcmp(name, "yuy2") || !strcmp(name, "yuyv")) {
+        *format = SECAMIZ0R_FORMAT_YUY2;
+    } else {
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Frame range in form of "N" or "N:M".
+ */
+static int parse_range(struct options *options, char const *value)
+{
+    char *end;
+
+    options->first_frame = (size_t) strtoull(value, &end, 10);
+
+    if (end == value) {
+        return 0;
+    }
+
+    if (*end == ':') {
+        char const *count = end + 1;
+
+        options->frame_count = (size_t) strtoull(count, &end, 10);
+
+        if (end == count) {
+            return 0;
+        }
+    }
+
+    return *end == '\0';
+}
+
+/**
+ * Returns zero if command line is not valid.
+ */
+static int parse_options(struct options *options, int argc, char **argv)
+{
+    int has_output_format = 0;
+    int positional = 0;
+
+    options->width = 0;
+    options->height = 0;
+    options->input_format = SECAMIZ0R_FORMAT_RGBA8888;
+    options->output_format = SECAMIZ0R_FORMAT_RGBA8888;
+    options->set_formats = 0;
+    options->fire_intensity = 0.125;
+    options->noise_intensity = 0.125;
+    options->use_mmap = 0;
+    options->thread_count = 1;
+    options->set_thread_count = 0;
+    options->first_frame = 0;
+    options->frame_count = SIZE_MAX;
+    options->strip_pairs = 0;
+    options->input_path = NULL;
+    options->output_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        char const *arg = argv[i];
+
+        if (arg[0] != '-' || !arg[1]) {
+            if (positional == 0) {
+                options->input_path = arg;
+            } else if (positional == 1) {
+                options->output_path = arg;
+            } else {
+                return 0;
+            }
+
+            positional++;
+            continue;
+        }
+
+        if (arg[2]) {
+            return 0;
+        }
+
+        if (arg[1] == 'm') {
+            options->use_mmap = 1;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            return 0;
+        }
+
+        char const *value = argv[++i];
+
+        switch (arg[1]) {
+        case 's':
+            if (sscanf(value, "%ux%u", &options->width, &options->height) != 2) {
+                return 0;
+            }
+            break;
+        case 'i':
+            if (!parse_format(&options->input_format, value)) {
+                return 0;
+            }
+            options->set_formats = 1;
+            break;
+        case 'o':
+            if (!parse_format(&options->output_format, value)) {
+                return 0;
+            }
+            has_output_format = 1;
+            options->set_formats = 1;
+            break;
+        case 'f':
+            options->fire_intensity = atof(value);
+            break;
+        case 'n':
+            options->noise_intensity = atof(value);
+            break;
+        case 't':
+            options->thread_count = (unsigned int) atoi(value);
+            options->set_thread_count = 1;
+            break;
+        case 'r':
+            if (!parse_range(options, value)) {
+                return 0;
+            }
+            break;
+        case 'p':
+            options->strip_pairs = (size_t) strtoull(value, NULL, 10);
+
+            if (options->strip_pairs == 0) {
+                return 0;
+            }
+            break;
+        default:
+            return 0;
+        }
+    }
+
+    if (!has_output_format) {
+        options->output_format = options->input_format;
+    }
+
+    return positional == 2;
+}
+
+/**
+ * fopen() which understands "-".
+ */
+static FILE *open_file(char const *path, char const *mode)
+{
+    if (strcmp(path, "-")) {
+        return fopen(path, mode);
+    }
+
+    FILE *file = (mode[0] == 'r') ? stdin : stdout;
+
+#ifdef _WIN32
+    _setmode(_fileno(file), _O_BINARY);
+#endif
+
+    return file;
+}
+
+/**
+ * Value of a YUV4MPEG2 header tag, or NULL if the header lacks it.
+ */
+static char const *find_y4m_tag(char const *header, char tag)
+{
+    for (char const *p = strchr(header, ' '); p; p = strchr(p + 1, ' ')) {
+        if (p[1] == tag) {
+            return &p[2];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Get frame size from YUV4MPEG2 stream header.
+ */
+static int parse_y4m_header(char const *header, unsigned int *width, unsigned int *height)
+{
+    char const *w_tag = find_y4m_tag(header, 'W');
+    char const *h_tag = find_y4m_tag(header, 'H');
+    unsigned int const w = w_tag ? (unsigned int) strtoul(w_tag, NULL, 10) : 0;
+    unsigned int const h = h_tag ? (unsigned int) strtoul(h_tag, NULL, 10) : 0;
+
+    if (w == 0 || h == 0) {
+        return 0;
+    }
+
+    *width = w;
+    *height = h;
+
+    return 1;
+}
+
+/**
+ * Get chroma subsampling from the C tag of YUV4MPEG2 stream header;
+ * 4:2:0 if there is none. Chroma siting is not told apart, samples are
+ * taken as they are. Only 8-bit colorspaces without alpha are supported.
+ */
+static int parse_y4m_colorspace(char const *header, struct y4m_chroma *chroma)
+{
+    static struct
+    {
+        char const *name;
+        struct y4m_chroma chroma;
+    } const colorspaces[] = {
+        { "420jpeg", { 1, 1 } },
+        { "420paldv", { 1, 1 } },
+        { "420mpeg2", { 1, 1 } },
+        { "420", { 1, 1 } },
+        { "422", { 1, 0 } },
+        { "444", { 0, 0 } },
+    };
+
+    char const *tag = find_y4m_tag(header, 'C');
+
+    if (!tag) {
+        chroma->x_shift = 1;
+        chroma->y_shift = 1;
+        return 1;
+    }
+
+    size_t const length = strcspn(tag, " ");
+
+    for (size_t i = 0; i < sizeof(colorspaces) / sizeof(colorspaces[0]); i++) {
+        if (strlen(colorspaces[i].name) == length && !strncmp(tag, colorspaces[i].name, length)) {
+            *chroma = colorspaces[i].chroma;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Size of a planar YUV4MPEG2 frame: luma plane, then both chroma planes.
+ */
+static size_t y4m_frame_size(unsigned int width, unsigned int height, struct y4m_chroma chroma)
+{
+    return (size_t) width * height + 2 * (size_t) (width >> chroma.x_shift) * (height >> chroma.y_shift);
+}
+
+/**
+ * Pack a planar frame as UYVY. 4:4:4 chroma of a pixel pair is averaged,
+ * 4:2:0 chroma rows are used by both rows they cover.
+ */
+static void planar_to_uyvy(uint8_t *dst, uint8_t const *src, unsigned int width, unsigned int height,
+                           struct y4m_chroma chroma)
+{
+    size_t const chroma_width = width >> chroma.x_shift;
+    uint8_t const *y_plane = src;
+    uint8_t const *u_plane = &src[(size_t) width * height];
+    uint8_t const *v_plane = &u_plane[chroma_width * (height >> chroma.y_shift)];
+
+    for (size_t y = 0; y < height; y++) {
+        uint8_t const *luma = &y_plane[y * width];
+        uint8_t const *u = &u_plane[(y >> chroma.y_shift) * chroma_width];
+        uint8_t const *v = &v_plane[(y >> chroma.y_shift) * chroma_width];
+        uint8_t *row = &dst[y * width * 2];
+
+        for (size_t x = 0; x < width; x += 2) {
+            if (chroma.x_shift) {
+                row[x * 2 + 0] = u[x / 2];
+                row[x * 2 + 2] = v[x / 2];
+            } else {
+                row[x * 2 + 0] = (uint8_t) ((u[x] + u[x + 1] + 1) / 2);
+                row[x * 2 + 2] = (uint8_t) ((v[x] + v[x + 1] + 1) / 2);
+            }
+
+            row[x * 2 + 1] = luma[x];
+            row[x * 2 + 3] = luma[x + 1];
+        }
+    }
+}
+
+/**
+ * Unpack a UYVY frame into planes. 4:4:4 chroma of a pixel pair is
+ * repeated, 4:2:0 chroma is averaged over row pairs.
+ */
+static void uyvy_to_planar(uint8_t *dst, uint8_t const *src, unsigned int width, unsigned int height,
+                           struct y4m_chroma chroma)
+{
+    size_t const chroma_width = width >> chroma.x_shift;
+    size_t const pitch = (size_t) width * 2;
+    uint8_t *y_plane = dst;
+    uint8_t *u_plane = &dst[(size_t) width * height];
+    uint8_t *v_plane = &u_plane[chroma_width * (height >> chroma.y_shift)];
+
+    for (size_t y = 0; y < height; y++) {
+        uint8_t const *row = &src[y * pitch];
+        uint8_t *luma = &y_plane[y * width];
+
+        for (size_t x = 0; x < width; x += 2) {
+            luma[x] = row[x * 2 + 1];
+            luma[x + 1] = row[x * 2 + 3];
+        }
+    }
+
+    for (size_t y = 0; y < (height >> chroma.y_shift); y++) {
+        uint8_t const *row = &src[(y << chroma.y_shift) * pitch];
+        uint8_t const *next = chroma.y_shift ? &row[pitch] : row;
+        uint8_t *u = &u_plane[y * chroma_width];
+        uint8_t *v = &v_plane[y * chroma_width];
+
+        for (size_t x = 0; x < width; x += 2) {
+            uint8_t const u_pair = (uint8_t) ((row[x * 2 + 0] + next[x * 2 + 0] + 1) / 2);
+            uint8_t const v_pair = (uint8_t) ((row[x * 2 + 2] + next[x * 2 + 2] + 1) / 2);
+
+            if (chroma.x_shift) {
+                u[x / 2] = u_pair;
+                v[x / 2] = v_pair;
+            } else {
+                u[x] = u[x + 1] = u_pair;
+                v[x] = v[x + 1] = v_pair;
+            }
+        }
+    }
+}
+
+/**
+ * Get image size from PAM header. Only 8-bit RGBA images are supported.
+ */
+static int parse_pam_header(char const *header, unsigned int *width, unsigned int *height)
+{
+    unsigned int w = 0;
+    unsigned int h = 0;
+    unsigned int depth = 0;
+    unsigned int maxval = 0;
+
+    for (char const *p = strchr(header, '\n'); p; p = strchr(p + 1, '\n')) {
+        if (!strncmp(&p[1], "WIDTH ", 6)) {
+            w = (unsigned int) strtoul(&p[7], NULL, 10);
+        } else if (!strncmp(&p[1], "HEIGHT ", 7)) {
+            h = (unsigned int) strtoul(&p[8], NULL, 10);
+        } else if (!strncmp(&p[1], "DEPTH ", 6)) {
+            depth = (unsigned int) strtoul(&p[7], NULL, 10);
+        } else if (!strncmp(&p[1], "MAXVAL ", 7)) {
+            maxval = (unsigned int) strtoul(&p[8], NULL, 10);
+        }
+    }
+
+    if (w == 0 || h == 0 || depth != 4 || maxval != 255) {
+        return 0;
+    }
+
+    *width = w;
+    *height = h;
+
+    return 1;
+}
+
+/**
+ * Map the whole input file into memory. Pages are expected to be
+ * touched once and in order, let the kernel know about that.
+ */
+static int map_input(struct input *input, char const *path)
+{
+#ifdef _WIN32
+    fprintf(stderr, "secamiz0r-cli: -m is not supported on this platform\n");
+    return 0;
+#else
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1) {
+        perror(path);
+        return 0;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        fprintf(stderr, "secamiz0r-cli: %s: can't map empty or special file\n", path);
+        close(fd);
+        return 0;
+    }
+
+    void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        perror(path);
+        return 0;
+    }
+
+    madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+
+    input->map = map;
+    input->map_size = (size_t) st.st_size;
+
+    return 1;
+#endif
+}
+
+/**
+ * Read the rest of a text line into the buffer, returns zero at EOF.
+ */
+static int read_line(FILE *file, char *line, size_t size)
+{
+    size_t length = 0;
+    int c;
+
+    while ((c = getc(file)) != EOF && c != '\n') {
+        if (length + 1 < size) {
+            line[length++] = (char) c;
+        }
+    }
+
+    line[length] = '\0';
+
+    return c == '\n';
+}
+
+/**
+ * Open input and figure out whether it's a YUV4MPEG2 stream.
+ */
+static int open_input(struct input *input, char const *path, int use_mmap)
+{
+    static char const magic[] = "YUV4MPEG2 ";
+    size_t const magic_length = sizeof(magic) - 1;
+
+    memset(input, 0, sizeof(*input));
+
+    if (use_mmap) {
+        if (!map_input(input, path)) {
+            return 0;
+        }
+
+        if (input->map_size > magic_length && !memcmp(input->map, magic, magic_length)) {
+            uint8_t const *end = memchr(input->map, '\n', input->map_size);
+
+            if (!end || (size_t) (end - input->map) >= sizeof(input->header)) {
+                fprintf(stderr, "secamiz0r-cli: %s: bad YUV4MPEG2 header\n", path);
+                return 0;
+            }
+
+            input->y4m = 1;
+            input->offset = (size_t) (end - input->map) + 1;
+            memcpy(input->header, input->map, input->offset - 1);
+        }
+
+        if (input->map_size > 3 && !memcmp(input->map, "P7\n", 3)) {
+            fprintf(stderr, "secamiz0r-cli: %s: PAM images can't be mapped\n", path);
+            return 0;
+        }
+
+        return 1;
+    }
+
+    input->file = open_file(path, "rb");
+
+    if (!input->file) {
+        perror(path);
+        return 0;
+    }
+
+    input->buffer = malloc(magic_length);
+
+    if (!input->buffer) {
+        return 0;
+    }
+
+    input->buffered = fread(input->buffer, 1, magic_length, input->file);
+
+    if (input->buffered == magic_length && !memcmp(input->buffer, magic, magic_length)) {
+        memcpy(input->header, magic, magic_length);
+
+        if (!read_line(input->file, &input->header[magic_length], sizeof(input->header) - magic_length)) {
+            fprintf(stderr, "secamiz0r-cli: %s: bad YUV4MPEG2 header\n", path);
+            return 0;
+        }
+
+        input->y4m = 1;
+        input->buffered = 0;
+    } else if (input->buffered >= 3 && !memcmp(input->buffer, "P7\n", 3)) {
+        // The header is kept as is, ENDHDR line included.
+        size_t length = input->buffered;
+
+        memcpy(input->header, input->buffer, length);
+
+        while (length < 7 || memcmp(&input->header[length - 7], "ENDHDR\n", 7)) {
+            int c = getc(input->file);
+
+            if (c == EOF || length + 1 >= sizeof(input->header)) {
+                fprintf(stderr, "secamiz0r-cli: %s: bad PAM header\n", path);
+                return 0;
+            }
+
+            input->header[length++] = (char) c;
+        }
+
+        input->header[length] = '\0';
+        input->pam = 1;
+        input->buffered = 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Read the FRAME line which starts every frame of a YUV4MPEG2 stream.
+ * Returns zero at the end of the stream, or if there is something else.
+ */
+static int read_frame_header(struct input *input)
+{
+    char line[256];
+
+    if (!read_line(input->file, line, sizeof(line)) || strncmp(line, "FRAME", 5)) {
+        input->truncated = line[0] != '\0';
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Returns pointer to the next frame, or NULL if there are no more frames
+ * or the input ends in the middle of one (see truncated).
+ * In mmap mode the pointer refers to the mapping itself.
+ */
+static uint8_t const *read_frame(struct input *input, size_t frame_size)
+{
+    if (input->map) {
+        if (input->y4m) {
+            uint8_t const *end = memchr(&input->map[input->offset], '\n', input->map_size - input->offset);
+
+            if (!end) {
+                input->truncated = input->offset < input->map_size;
+                return NULL;
+            }
+
+            input->offset = (size_t) (end - input->map) + 1;
+        }
+
+        if (input->map_size - input->offset < frame_size) {
+            input->truncated = input->y4m || input->offset < input->map_size;
+            return NULL;
+        }
+
+        uint8_t const *frame = &input->map[input->offset];
+        input->offset += frame_size;
+
+#ifndef _WIN32
+        size_t const page_size = (size_t) sysconf(_SC_PAGESIZE);
+        size_t const done = ((size_t) (frame - input->map) / page_size) * page_size;
+        size_t const ahead = input->map_size - done;
+
+        // Previous frames won't be needed again, upcoming ones will be soon.
+        madvise((void *) input->map, done, MADV_DONTNEED);
+        madvise((void *) &input->map[done], (ahead < frame_size * READAHEAD_FRAMES) ? ahead : frame_size * READAHEAD_FRAMES, MADV_WILLNEED);
+#endif
+
+        return frame;
+    }
+
+    if (input->y4m && !read_frame_header(input)) {
+        return NULL;
+    }
+
+    if (input->buffered < frame_size) {
+        uint8_t *buffer = realloc(input->buffer, frame_size);
+
+        if (!buffer) {
+            return NULL;
+        }
+
+        input->buffer = buffer;
+
+        size_t const length = fread(&buffer[input->buffered], 1, frame_size - input->buffered, input->file);
+
+        if (input->buffered + length < frame_size) {
+            input->truncated = input->y4m || input->buffered + length > 0;
+            return NULL;
+        }
+    }
+
+    input->buffered = 0;
+
+    return input->buffer;
+}
+
+/**
+ * Read the next strip of a frame. Bytes left in the buffer after looking
+ * for a container header go first.
+ */
+static int read_strip(struct input *input, uint8_t *strip, size_t size)
+{
+    size_t const buffered = (input->buffered < size) ? input->buffered : size;
+
+    memcpy(strip, input->buffer, buffered);
+    memmove(input->buffer, &input->buffer[buffered], input->buffered - buffered);
+    input->buffered -= buffered;
+
+    size_t const length = buffered + fread(&strip[buffered], 1, size - buffered, input->file);
+
+    if (length < size) {
+        input->truncated = length > 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Skip frames preceding the requested range. Returns zero if the input
+ * ends before that.
+ */
+static int skip_frames(struct input *input, size_t count, size_t frame_size)
+{
+    if (input->map && !input->y4m) {
+        if ((input->map_size - input->offset) / frame_size < count) {
+            return 0;
+        }
+
+        input->offset += count * frame_size;
+        return 1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (input->file && !input->y4m && input->buffered == 0 && input->file != stdin) {
+            if (fseek(input->file, (long) frame_size, SEEK_CUR) == 0) {
+                continue;
+            }
+        }
+
+        if (!read_frame(input, frame_size)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Returns zero if reading has stopped because of an error.
+ */
+static int close_input(struct input *input)
+{
+    int ok = 1;
+
+    if (input->map) {
+#ifndef _WIN32
+        munmap((void *) input->map, input->map_size);
+#endif
+    }
+
+    if (input->file) {
+        ok = !ferror(input->file);
+
+        if (input->file != stdin) {
+            fclose(input->file);
+        }
+    }
+
+    free(input->buffer);
+
+    return ok;
+}
+
+/**
+ * Write one filtered frame.
+ */
+static int write_frame(struct output *output, uint8_t const *frame)
+{
+    if (output->y4m && fputs("FRAME\n", output->file) == EOF) {
+        return 0;
+    }
+
+    return fwrite(frame, output->frame_size, 1, output->file) == 1;
+}
+
+#ifdef SECAMIZ0R_THREADS
+/**
+ * Writer thread: writes filled buffers in order and hands them back.
+ */
+static void *writer_main(void *arg)
+{
+    struct output *output = arg;
+
+    pthread_mutex_lock(&output->mutex);
+
+    while (1) {
+        while (output->written == output->filled && !output->done) {
+            pthread_cond_wait(&output->cond, &output->mutex);
+        }
+
+        if (output->written == output->filled) {
+            break;
+        }
+
+        uint8_t const *frame = output->pool[output->written % OUTPUT_POOL_SIZE];
+
+        pthread_mutex_unlock(&output->mutex);
+        int ok = output->failed || write_frame(output, frame);
+        pthread_mutex_lock(&output->mutex);
+
+        output->failed = !ok;
+        output->written++;
+        pthread_cond_broadcast(&output->cond);
+    }
+
+    pthread_mutex_unlock(&output->mutex);
+
+    return NULL;
+}
+#endif
+
+/**
+ * YUV4MPEG2 header is given if the stream starts in this output.
+ */
+static int open_output(struct output *output, char const *path, int y4m, char const *y4m_header, size_t frame_size)
+{
+    memset(output, 0, sizeof(*output));
+
+    output->y4m = y4m;
+
+    output->file = open_file(path, "wb");
+
+    if (!output->file) {
+        perror(path);
+        return 0;
+    }
+
+    output->frame_size = frame_size;
+
+    for (int i = 0; i < OUTPUT_POOL_SIZE; i++) {
+        output->pool[i] = malloc(frame_size);
+
+        if (!output->pool[i]) {
+            return 0;
+        }
+    }
+
+    if (y4m_header) {
+        if (fprintf(output->file, "%s\n", y4m_header) < 0) {
+            perror(path);
+            return 0;
+        }
+    }
+
+#ifdef SECAMIZ0R_THREADS
+    pthread_mutex_init(&output->mutex, NULL);
+    pthread_cond_init(&output->cond, NULL);
+
+    if (pthread_create(&output->writer, NULL, writer_main, output) != 0) {
+        return 0;
+    }
+#endif
+
+    return 1;
+}
+
+/**
+ * Get a free buffer from the pool, waiting for the writer if there are none.
+ */
+static uint8_t *acquire_frame(struct output *output)
+{
+#ifdef SECAMIZ0R_THREADS
+    pthread_mutex_lock(&output->mutex);
+
+    while (output->filled - output->written >= OUTPUT_POOL_SIZE) {
+        pthread_cond_wait(&output->cond, &output->mutex);
+    }
+
+    pthread_mutex_unlock(&output->mutex);
+#endif
+
+    return output->pool[output->filled % OUTPUT_POOL_SIZE];
+}
+
+/**
+ * Pass the buffer returned by acquire_frame() to the writer.
+ * Returns zero if writing has failed (maybe a few frames ago).
+ */
+static int submit_frame(struct output *output)
+{
+#ifdef SECAMIZ0R_THREADS
+    pthread_mutex_lock(&output->mutex);
+    output->filled++;
+    pthread_cond_broadcast(&output->cond);
+    int ok = !output->failed;
+    pthread_mutex_unlock(&output->mutex);
+
+    return ok;
+#else
+    output->failed = !write_frame(output, output->pool[output->filled++ % OUTPUT_POOL_SIZE]);
+    output->written = output->filled;
+
+    return !output->failed;
+#endif
+}
+
+/**
+ * Flush everything. Returns zero if some frames weren't written.
+ */
+static int close_output(struct output *output)
+{
+#ifdef SECAMIZ0R_THREADS
+    pthread_mutex_lock(&output->mutex);
+    output->done = 1;
+    pthread_cond_broadcast(&output->cond);
+    pthread_mutex_unlock(&output->mutex);
+
+    pthread_join(output->writer, NULL);
+    pthread_cond_destroy(&output->cond);
+    pthread_mutex_destroy(&output->mutex);
+#endif
+
+    int ok = !output->failed && fflush(output->file) == 0;
+
+    if (output->file != stdout) {
+        ok = (fclose(output->file) == 0) && ok;
+    }
+
+    for (int i = 0; i < OUTPUT_POOL_SIZE; i++) {
+        free(output->pool[i]);
+    }
+
+    return ok;
+}
+
+/**
+ * Filter frames a strip of row pairs at a time: only one strip of the
+ * source and one of the output are in memory at once, however tall
+ * the frames are. The output is the same as if whole frames were
+ * filtered. Frames preceding the range are read and thrown away.
+ */
+static int run_strips(struct options const *options, struct input *input)
+{
+    size_t const frame_pairs = options->height / 2;
+    size_t const strip_pairs = (options->strip_pairs < frame_pairs) ? options->strip_pairs : frame_pairs;
+    size_t const src_pair_size = secamiz0r_frame_size(options->width, 2, options->input_format);
+    size_t const dst_pair_size = secamiz0r_frame_size(options->width, 2, options->output_format);
+
+    uint8_t *src = malloc(src_pair_size * strip_pairs);
+    uint8_t *dst = malloc(dst_pair_size * strip_pairs);
+    f0r_instance_t instance = f0r_construct(options->width, (unsigned int) strip_pairs * 2);
+
+    if (!src || !dst || !instance
+        || (options->set_thread_count && !secamiz0r_set_threads(instance, options->thread_count))) {
+        fprintf(stderr, "secamiz0r-cli: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    double fire_intensity = options->fire_intensity;
+    double noise_intensity = options->noise_intensity;
+
+    f0r_set_param_value(instance, &fire_intensity, 0);
+    f0r_set_param_value(instance, &noise_intensity, 1);
+
+    FILE *output = open_file(options->output_path, "wb");
+
+    if (!output) {
+        perror(options->output_path);
+        return EXIT_FAILURE;
+    }
+
+    int ok = 1;
+
+    if (input->pam) {
+        ok = fputs(input->header, output) != EOF;
+    }
+
+    size_t frame = 0;
+
+    while (ok && (frame < options->first_frame || frame - options->first_frame < options->frame_count)) {
+        int const render = frame >= options->first_frame;
+        size_t first_pair = 0;
+
+        for (; ok && first_pair < frame_pairs; first_pair += strip_pairs) {
+            size_t const pairs = (frame_pairs - first_pair < strip_pairs) ? (frame_pairs - first_pair) : strip_pairs;
+
+            if (!read_strip(input, src, src_pair_size * pairs)) {
+                break;
+            }
+
+            if (render) {
+                secamiz0r_update_strip(instance, frame, first_pair, pairs, src, options->input_format, dst, options->output_format);
+                ok = fwrite(dst, dst_pair_size * pairs, 1, output) == 1;
+            }
+        }
+
+        if (first_pair < frame_pairs) {
+            if (ok && (first_pair > 0 || input->pam || input->truncated)) {
+                fprintf(stderr, "secamiz0r-cli: %s: frame %zu is cut short\n", options->input_path, frame);
+                ok = 0;
+            }
+
+            break;
+        }
+
+        frame++;
+
+        // A PAM file holds one image.
+        if (input->pam) {
+            break;
+        }
+    }
+
+    if (ok && input->truncated) {
+        fprintf(stderr, "secamiz0r-cli: %s: frame %zu is cut short\n", options->input_path, frame);
+        ok = 0;
+    }
+
+    int status = ok ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (ok && frame < options->first_frame) {
+        fprintf(stderr, "secamiz0r-cli: %s: there are less than %zu frames\n", options->input_path, options->first_frame);
+        status = EXIT_FAILURE;
+    }
+
+    if (!close_input(input)) {
+        perror(options->input_path);
+        status = EXIT_FAILURE;
+    }
+
+    if (fflush(output) != 0 || ferror(output)) {
+        perror(options->output_path);
+        status = EXIT_FAILURE;
+    }
+
+    if (output != stdout) {
+        fclose(output);
+    }
+
+    f0r_destruct(instance);
+    free(src);
+    free(dst);
+
+    return status;
+}
+
+int main(int argc, char **argv)
+{
+    struct options options;
+    struct input input;
+    struct output output;
+
+    if (!parse_options(&options, argc, argv)) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    if (!open_input(&input, options.input_path, options.use_mmap)) {
+        return EXIT_FAILURE;
+    }
+
+    if (input.y4m) {
+        if (!parse_y4m_header(input.header, &options.width, &options.height)) {
+            fprintf(stderr, "secamiz0r-cli: %s: YUV4MPEG2 header lacks frame size\n", options.input_path);
+            return EXIT_FAILURE;
+        }
+
+        if (!parse_y4m_colorspace(input.header, &input.chroma)) {
+            fprintf(stderr, "secamiz0r-cli: %s: YUV4MPEG2 colorspace is not supported\n", options.input_path);
+            return EXIT_FAILURE;
+        }
+
+        // Planes are packed as UYVY for the filter, and back.
+        if (options.set_formats) {
+            fprintf(stderr, "secamiz0r-cli: YUV4MPEG2 frames are planar YUV, -i and -o don't apply\n");
+            return EXIT_FAILURE;
+        }
+
+        if (options.strip_pairs > 0) {
+            fprintf(stderr, "secamiz0r-cli: YUV4MPEG2 frames are not filtered in strips\n");
+            return EXIT_FAILURE;
+        }
+
+        options.input_format = SECAMIZ0R_FORMAT_UYVY;
+        options.output_format = SECAMIZ0R_FORMAT_UYVY;
+    }
+
+    if (input.pam) {
+        if (!parse_pam_header(input.header, &options.width, &options.height)) {
+            fprintf(stderr, "secamiz0r-cli: %s: only 8-bit RGBA PAM images are supported\n", options.input_path);
+            return EXIT_FAILURE;
+        }
+
+        if (options.input_format != SECAMIZ0R_FORMAT_RGBA8888 || options.output_format != SECAMIZ0R_FORMAT_RGBA8888) {
+            fprintf(stderr, "secamiz0r-cli: PAM images are RGBA\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (options.width == 0 || options.height == 0) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    if ((options.width % 2) || (options.height % 2)) {
+        fprintf(stderr, "secamiz0r-cli: frame width and height must be even\n");
+        return EXIT_FAILURE;
+    }
+
+    if (input.pam || options.strip_pairs > 0) {
+        if (options.use_mmap) {
+            fprintf(stderr, "secamiz0r-cli: strips are not read from mapped files\n");
+            return EXIT_FAILURE;
+        }
+
+        if (options.strip_pairs == 0) {
+            options.strip_pairs = DEFAULT_STRIP_PAIRS;
+        }
+
+        return run_strips(&options, &input);
+    }
+
+    size_t const src_size = input.y4m ? y4m_frame_size(options.width, options.height, input.chroma)
+                                      : secamiz0r_frame_size(options.width, options.height, options.input_format);
+    size_t const dst_size = input.y4m ? src_size
+                                      : secamiz0r_frame_size(options.width, options.height, options.output_format);
+
+    if (!skip_frames(&input, options.first_frame, src_size)) {
+        fprintf(stderr, "secamiz0r-cli: %s: there are less than %zu frames\n", options.input_path, options.first_frame);
+        return EXIT_FAILURE;
+    }
+
+    int const write_header = input.y4m && options.first_frame == 0;
+
+    if (!open_output(&output, options.output_path, input.y4m, write_header ? input.header : NULL, dst_size)) {
+        fprintf(stderr, "secamiz0r-cli: failed to set up output\n");
+        return EXIT_FAILURE;
+    }
+
+    f0r_instance_t instance = f0r_construct(options.width, options.height);
+
+    // Planar frames are filtered in place, packed in this buffer.
+    uint8_t *packed = input.y4m ? malloc(secamiz0r_frame_size(options.width, options.height, SECAMIZ0R_FORMAT_UYVY)) : NULL;
+
+    if (!instance || (input.y4m && !packed)) {
+        fprintf(stderr, "secamiz0r-cli: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    if (options.set_thread_count && !secamiz0r_set_threads(instance, options.thread_count)) {
+        fprintf(stderr, "secamiz0r-cli: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    f0r_set_param_value(instance, &options.fire_intensity, 0);
+    f0r_set_param_value(instance, &options.noise_intensity, 1);
+
+    size_t frames = 0;
+    int status = EXIT_SUCCESS;
+    uint8_t const *src;
+
+    while (frames < options.frame_count && (src = read_frame(&input, src_size))) {
+        uint8_t *dst = acquire_frame(&output);
+        size_t const frame_index = options.first_frame + frames;
+
+        if (packed) {
+            planar_to_uyvy(packed, src, options.width, options.height, input.chroma);
+            secamiz0r_update_frame(instance, frame_index, packed, SECAMIZ0R_FORMAT_UYVY, packed, SECAMIZ0R_FORMAT_UYVY);
+            uyvy_to_planar(dst, packed, options.width, options.height, input.chroma);
+        } else {
+            secamiz0r_update_frame(instance, frame_index, src, options.input_format, dst, options.output_format);
+        }
+
+        if (!submit_frame(&output)) {
+            break;
+        }
+
+        frames++;
+    }
+
+    if (input.truncated) {
+        fprintf(stderr, "secamiz0r-cli: %s: frame %zu is cut short\n", options.input_path, options.first_frame + frames);
+        status = EXIT_FAILURE;
+    }
+
+    if (!close_input(&input)) {
+        perror(options.input_path);
+        status = EXIT_FAILURE;
+    }
+
+    if (!close_output(&output)) {
+        perror(options.output_path);
+        status = EXIT_FAILURE;
+    }
+
+    f0r_destruct(instance);
+    free(packed);
+
+    return status;
+}
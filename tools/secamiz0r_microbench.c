@@ -0,0 +1,599 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_microbench.c: time each filtering stage in isolation.
+ * Stage functions are static, so the plugin source is included here.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "secamiz0r.c"
+#include "perf_counters.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+/**
+ * Each measurement lasts at least this long, in seconds.
+ */
+#define MIN_DURATION 0.02
+
+/**
+ * Best of this many measurements is reported.
+ */
+#define REPEATS 5
+
+/**
+ * Row pair buffers for one width. Inputs of each stage are prepared once
+ * and restored before every call, since stages work in place.
+ */
+struct bench
+{
+    struct secamiz0r *self;
+    size_t width;
+    struct span span;
+    struct params params;
+    struct pair_stats stats;
+
+    uint8_t *src;          // RGBA source rows
+    uint8_t *src_packed;   // UYVY source rows
+    uint8_t *yuv;          // output of stage 1
+    uint8_t *prefiltered;  // output of stage 2.1
+    uint8_t *filtered;     // output of stage 2.2
+    uint8_t *work;         // working rows
+    uint8_t *out_packed;   // UYVY destination rows
+
+    f0r_instance_t frame_instance;
+    unsigned int frame_height;
+    uint32_t *frame_src;
+    uint32_t *frame_dst;
+};
+
+/**
+ * Stage under test. Runs the stage once, restoring its input first if
+ * the stage works in place, or filters a whole frame.
+ */
+struct stage
+{
+    char const *name;
+    void (*run)(struct bench *bench);
+    int restores_input;
+    int whole_frame;
+};
+
+/**
+ * Measured cost of a single call.
+ */
+struct result
+{
+    double seconds;
+    double cycles;
+    double counts[PERF_COUNTER_COUNT];
+};
+
+static double get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static uint64_t get_cycles(void)
+{
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+#define EVEN(buffer) (&(bench)->buffer[0])
+#define ODD(buffer) (&(bench)->buffer[(bench)->width * 4])
+
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE
+#endif
+
+static NOINLINE void run_nothing(struct bench *bench)
+{
+    (void) bench;
+}
+
+static NOINLINE void run_restore(struct bench *bench)
+{
+    memcpy(bench->work, bench->yuv, bench->width * 8);
+}
+
+static NOINLINE void run_copy_pair_as_yuv(struct bench *bench)
+{
+    copy_pair_as_yuv(bench->self, EVEN(work), ODD(work), EVEN(src), ODD(src), bench->width);
+}
+
+static NOINLINE void run_copy_pair_from_packed(struct bench *bench)
+{
+    copy_pair_from_packed(bench->self, EVEN(work), ODD(work), &bench->src_packed[0], &bench->src_packed[bench->width * 2], bench->width, &uyvy_layout);
+}
+
+static NOINLINE void run_prefilter_pair(struct bench *bench)
+{
+    memcpy(bench->work, bench->yuv, bench->width * 8);
+    prefilter_pair(bench->self, EVEN(work), ODD(work), &bench->span);
+}
+
+static NOINLINE void run_shift_line(struct bench *bench)
+{
+    memcpy(bench->work, bench->yuv, bench->width * 8);
+    shift_line(bench->self, EVEN(work), bench->width, 3);
+    shift_line(bench->self, ODD(work), bench->width, 2);
+}
+
+static NOINLINE void run_filter_pair(struct bench *bench)
+{
+    memcpy(bench->work, bench->prefiltered, bench->width * 8);
+    filter_pair(bench->self, EVEN(work), ODD(work), &bench->span);
+}
+
+static NOINLINE void run_convert_pair_to_rgb(struct bench *bench)
+{
+    memcpy(bench->work, bench->filtered, bench->width * 8);
+    convert_pair_to_rgb(bench->self, EVEN(work), ODD(work), bench->width);
+}
+
+static NOINLINE void run_convert_pair_to_packed(struct bench *bench)
+{
+    convert_pair_to_packed(bench->self, &bench->out_packed[0], &bench->out_packed[bench->width * 2], EVEN(filtered), ODD(filtered), bench->width, &uyvy_layout);
+}
+
+static NOINLINE void run_process_rgba_pair(struct bench *bench)
+{
+    bench->self->process_rgba_pair(bench->self, EVEN(work), ODD(work), EVEN(src), ODD(src), &bench->span);
+}
+
+static NOINLINE void run_f0r_update(struct bench *bench)
+{
+    f0r_update(bench->frame_instance, 0.0, bench->frame_src, bench->frame_dst);
+}
+
+/**
+ * Stages which restore their input subtract the cost of restoring.
+ */
+static struct stage const stages[] = {
+    { "copy_pair_as_yuv", run_copy_pair_as_yuv, 0, 0 },
+    { "copy_pair_from_packed", run_copy_pair_from_packed, 0, 0 },
+    { "prefilter_pair", run_prefilter_pair, 1, 0 },
+    { "shift_line", run_shift_line, 1, 0 },
+    { "filter_pair", run_filter_pair, 1, 0 },
+    { "convert_pair_to_rgb", run_convert_pair_to_rgb, 1, 0 },
+    { "convert_pair_to_packed", run_convert_pair_to_packed, 0, 0 },
+    { "process_rgba_pair", run_process_rgba_pair, 0, 0 },
+    { "f0r_update", run_f0r_update, 0, 1 },
+};
+
+/**
+ * Best time and cycle count per call out of a few measurements.
+ * Buffers are warmed up first, so row pairs are in L1/L2.
+ * Performance counters, if given, are averaged over all measurements.
+ */
+static void measure(struct bench *bench, void (*run)(struct bench *bench), struct perf_counters *counters, struct result *result)
+{
+    size_t iterations = 1;
+
+    for (int i = 0; i < 16; i++) {
+        run(bench);
+    }
+
+    while (1) {
+        double t0 = get_time();
+
+        for (size_t i = 0; i < iterations; i++) {
+            run(bench);
+        }
+
+        if (get_time() - t0 >= MIN_DURATION) {
+            break;
+        }
+
+        iterations *= 2;
+    }
+
+    result->seconds = 1e9;
+    result->cycles = 1e18;
+
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        result->counts[i] = 0.0;
+    }
+
+    for (int r = 0; r < REPEATS; r++) {
+        uint64_t values[PERF_COUNTER_COUNT];
+
+        if (counters) {
+            perf_counters_start(counters);
+        }
+
+        double t0 = get_time();
+        uint64_t c0 = get_cycles();
+
+        for (size_t i = 0; i < iterations; i++) {
+            run(bench);
+        }
+
+        uint64_t c1 = get_cycles();
+        double t1 = get_time();
+
+        if (counters) {
+            perf_counters_stop(counters, values);
+
+            for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+                result->counts[i] += (double) values[i] / (iterations * REPEATS);
+            }
+        }
+
+        if ((t1 - t0) / iterations < result->seconds) {
+            result->seconds = (t1 - t0) / iterations;
+        }
+
+        if ((double) (c1 - c0) / iterations < result->cycles) {
+            result->cycles = (double) (c1 - c0) / iterations;
+        }
+    }
+}
+
+/**
+ * Deterministic mode: counts of exactly one call, after one call to warm
+ * everything up, less the cost of starting and stopping counters.
+ * Content, seeds and thread count are fixed, so the counts only change
+ * when the code does.
+ */
+static void count(struct bench *bench, void (*run)(struct bench *bench), struct perf_counters *counters, struct result *result)
+{
+    uint64_t values[PERF_COUNTER_COUNT];
+    uint64_t baseline[PERF_COUNTER_COUNT];
+
+    run_nothing(bench);
+    perf_counters_start(counters);
+    run_nothing(bench);
+    perf_counters_stop(counters, baseline);
+
+    run(bench);
+    perf_counters_start(counters);
+    run(bench);
+    perf_counters_stop(counters, values);
+
+    result->seconds = 0.0;
+    result->cycles = 0.0;
+
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        result->counts[i] = (double) values[i] - (double) baseline[i];
+    }
+}
+
+/**
+ * Print per-call totals and per-pixel figures of the deterministic mode.
+ * Counters which can't be opened are shown as "-".
+ */
+static void print_counts(char const *name, size_t width, double pixels, struct result const *result, struct perf_counters const *counters)
+{
+    static enum perf_counter const columns[] = { PERF_INSTRUCTIONS, PERF_L1D_LOADS, PERF_L1D_STORES };
+
+    printf("%-24s %6zu", name, width);
+
+    if (perf_counter_available(counters, PERF_INSTRUCTIONS)) {
+        printf(" %14.0f", result->counts[PERF_INSTRUCTIONS]);
+    } else {
+        printf(" %14s", "-");
+    }
+
+    for (size_t i = 0; i < sizeof(columns) / sizeof(*columns); i++) {
+        if (perf_counter_available(counters, columns[i])) {
+            printf(" %11.3f", result->counts[columns[i]] / pixels);
+        } else {
+            printf(" %11s", "-");
+        }
+    }
+
+    printf("\n");
+}
+
+/**
+ * Print per-pixel figures. With counters, cycles are real core cycles
+ * rather than TSC ticks when available.
+ */
+static void print_result(char const *name, size_t width, double pixels, struct result const *result, struct perf_counters const *counters)
+{
+    printf("%-24s %6zu %10.3f", name, width, 1e9 * result->seconds / pixels);
+
+    if (!counters) {
+        printf(" %10.2f\n", result->cycles / pixels);
+        return;
+    }
+
+    double const cycles = perf_counter_available(counters, PERF_CYCLES) ? result->counts[PERF_CYCLES] : result->cycles;
+
+    printf(" %10.2f", cycles / pixels);
+
+    if (perf_counter_available(counters, PERF_INSTRUCTIONS) && cycles > 0.0) {
+        printf(" %6.2f", result->counts[PERF_INSTRUCTIONS] / cycles);
+    } else {
+        printf(" %6s", "-");
+    }
+
+    for (int i = PERF_L1D_MISSES; i <= PERF_BRANCH_MISSES; i++) {
+        if (perf_counter_available(counters, (enum perf_counter) i)) {
+            printf(" %13.4f", result->counts[i] / pixels);
+        } else {
+            printf(" %13s", "-");
+        }
+    }
+
+    printf("\n");
+}
+
+/**
+ * Same kind of content as in secamiz0r-bench, one row pair of it.
+ */
+static void fill_rows(uint8_t *rows, size_t width)
+{
+    for (size_t y = 0; y < 2; y++) {
+        for (size_t x = 0; x < width; x++) {
+            uint8_t *pixel = &rows[(y * width + x) * 4];
+            unsigned int band = (unsigned int) (x / 64 + y) % 4;
+
+            pixel[0] = (uint8_t) ((x * 255) / width);
+            pixel[1] = (uint8_t) (128 + y * 64);
+            pixel[2] = (uint8_t) (band * 85);
+            pixel[3] = 255;
+        }
+    }
+}
+
+/**
+ * Frames for f0r_update() are 16:9, so that whole-frame numbers show
+ * what happens when the frame doesn't fit in caches any more.
+ */
+static int setup_bench(struct bench *bench, size_t width)
+{
+    memset(bench, 0, sizeof(*bench));
+
+    bench->self = f0r_construct((unsigned int) width, 2);
+    bench->width = width;
+    bench->span.frame_index = 1;
+    bench->span.pair = 0;
+    bench->span.x = 0;
+    bench->span.width = width;
+    bench->span.stats = &bench->stats;
+
+    bench->src = malloc(width * 8);
+    bench->src_packed = malloc(width * 4);
+    bench->yuv = malloc(width * 8);
+    bench->prefiltered = malloc(width * 8);
+    bench->filtered = malloc(width * 8);
+    bench->work = malloc(width * 8);
+    bench->out_packed = malloc(width * 4);
+
+    bench->frame_height = (unsigned int) ((width * 9 / 16) & ~(size_t) 1);
+    bench->frame_instance = f0r_construct((unsigned int) width, bench->frame_height);
+    bench->frame_src = malloc(width * bench->frame_height * 4);
+    bench->frame_dst = malloc(width * bench->frame_height * 4);
+
+    if (!bench->self || !bench->src || !bench->src_packed || !bench->yuv || !bench->prefiltered
+        || !bench->filtered || !bench->work || !bench->out_packed
+        || !bench->frame_instance || !bench->frame_src || !bench->frame_dst) {
+        return 0;
+    }
+
+    double fire = 0.5;
+    double noise = 0.5;
+
+    f0r_set_param_value(bench->self, &fire, 0);
+    f0r_set_param_value(bench->self, &noise, 1);
+    f0r_set_param_value(bench->frame_instance, &fire, 0);
+    f0r_set_param_value(bench->frame_instance, &noise, 1);
+    take_params(bench->self, &bench->params);
+    bench->span.params = &bench->params;
+
+    fill_rows(bench->src, width);
+
+    for (unsigned int y = 0; y < bench->frame_height; y += 2) {
+        memcpy(&bench->frame_src[y * width], bench->src, width * 8);
+    }
+
+    copy_pair_as_yuv(bench->self, EVEN(yuv), ODD(yuv), EVEN(src), ODD(src), width);
+    convert_pair_to_packed(bench->self, &bench->src_packed[0], &bench->src_packed[width * 2], EVEN(yuv), ODD(yuv), width, &uyvy_layout);
+
+    memcpy(bench->prefiltered, bench->yuv, width * 8);
+    prefilter_pair(bench->self, EVEN(prefiltered), ODD(prefiltered), &bench->span);
+
+    memcpy(bench->filtered, bench->prefiltered, width * 8);
+    filter_pair(bench->self, EVEN(filtered), ODD(filtered), &bench->span);
+
+    return 1;
+}
+
+static void cleanup_bench(struct bench *bench)
+{
+    f0r_destruct(bench->self);
+    free(bench->src);
+    free(bench->src_packed);
+    free(bench->yuv);
+    free(bench->prefiltered);
+    free(bench->filtered);
+    free(bench->work);
+    free(bench->out_packed);
+    f0r_destruct(bench->frame_instance);
+    free(bench->frame_src);
+    free(bench->frame_dst);
+}
+
+int main(int argc, char **argv)
+{
+    static size_t const default_widths[] = { 720, 1920, 3840, 7680 };
+
+    size_t widths[16];
+    size_t width_count = 0;
+    int use_counters = 0;
+    int deterministic = 0;
+
+    for (int i = 1; i < argc && width_count < 16; i++) {
+        if (!strcmp(argv[i], "-p")) {
+            use_counters = 1;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-d")) {
+            use_counters = 1;
+            deterministic = 1;
+            continue;
+        }
+
+        widths[width_count] = (size_t) strtoul(argv[i], NULL, 10);
+
+        if (widths[width_count] < 16 || (widths[width_count] % 2)) {
+            fprintf(stderr, "usage: secamiz0r-microbench [-p | -d] [WIDTH...]\n"
+                            "  -p  read hardware performance counters as well\n"
+                            "  -d  count instructions and memory accesses of a single call\n"
+                            "widths must be even and at least 16 pixels\n");
+            return EXIT_FAILURE;
+        }
+
+        width_count++;
+    }
+
+    // Stages are measured as they are, not as tuned for this machine.
+    setenv("SECAMIZ0R_AUTOTUNE", "0", 1);
+
+    if (deterministic) {
+        setenv("SECAMIZ0R_NUM_THREADS", "1", 1);
+    }
+
+    if (width_count == 0) {
+        memcpy(widths, default_widths, sizeof(default_widths));
+        width_count = sizeof(default_widths) / sizeof(*default_widths);
+    }
+
+    struct perf_counters perf;
+    struct perf_counters *counters = NULL;
+
+    if (use_counters) {
+        if (perf_counters_open(&perf) > 0) {
+            counters = &perf;
+
+            for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+                if (!perf_counter_available(&perf, (enum perf_counter) i)) {
+                    printf("# %s counter is not available\n", perf_counter_name((enum perf_counter) i));
+                }
+            }
+        } else if (deterministic) {
+            printf("# performance counters are not available, run this under\n"
+                   "# valgrind --tool=callgrind --toggle-collect='run_*' instead\n");
+        } else {
+            printf("# performance counters are not available, falling back to time and TSC\n");
+        }
+    }
+
+    if (deterministic) {
+        printf("%-24s %6s %14s %11s %11s %11s\n", "stage", "width", "instructions", "instr/px", "loads/px", "stores/px");
+    }
+
+#ifndef HAVE_TSC
+    if (!counters && !deterministic) {
+        printf("# no cycle counter on this platform, only time is reported\n");
+    }
+#endif
+
+    if (!deterministic) {
+        printf("%-24s %6s %10s %10s", "stage", "width", "ns/px", "cycles/px");
+
+        if (counters) {
+            printf(" %6s %13s %13s %13s", "IPC", "L1d-miss/px", "LLC-miss/px", "br-miss/px");
+        }
+
+        printf("\n");
+    }
+
+    for (size_t w = 0; w < width_count; w++) {
+        struct bench bench;
+
+        if (!setup_bench(&bench, widths[w])) {
+            fprintf(stderr, "secamiz0r-microbench: out of memory\n");
+            return EXIT_FAILURE;
+        }
+
+        struct result restore;
+
+        if (deterministic) {
+            // Without counters stages just run once each, for a simulator.
+            if (counters) {
+                count(&bench, run_restore, counters, &restore);
+            } else {
+                run_restore(&bench);
+            }
+        } else {
+            measure(&bench, run_restore, counters, &restore);
+        }
+
+        for (size_t i = 0; i < sizeof(stages) / sizeof(*stages); i++) {
+            struct result result;
+
+            if (deterministic && !counters) {
+                stages[i].run(&bench);
+                continue;
+            }
+
+            if (deterministic) {
+                count(&bench, stages[i].run, counters, &result);
+            } else {
+                measure(&bench, stages[i].run, counters, &result);
+            }
+
+            if (stages[i].restores_input) {
+                result.seconds -= restore.seconds;
+                result.cycles -= restore.cycles;
+
+                for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+                    result.counts[c] -= restore.counts[c];
+                }
+            }
+
+            // Per pixel of the row pair, or of the frame.
+            double const pixels = (double) bench.width * (stages[i].whole_frame ? bench.frame_height : 2);
+
+            if (deterministic) {
+                print_counts(stages[i].name, bench.width, pixels, &result, counters);
+            } else {
+                print_result(stages[i].name, bench.width, pixels, &result, counters);
+            }
+        }
+
+        cleanup_bench(&bench);
+    }
+
+    if (counters) {
+        perf_counters_close(counters);
+    }
+
+    return EXIT_SUCCESS;
+}
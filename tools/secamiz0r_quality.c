@@ -0,0 +1,580 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_quality.c: compare output of two configurations of the filter.
+ * Stage functions are static, so the plugin source is included here.
+ *
+ * Both configurations filter the same frames with the same frame indices,
+ * so random generators are seeded the same way. For every stage and channel
+ * the tool reports:
+ *
+ *  - PSNR (of mean squared error over all frames) and mean SSIM of the
+ *    alternative against the reference: the total difference;
+ *  - PSNR of the per-pixel means over all frames: noise and line shifts
+ *    mostly average out, so this is the difference in the signal itself;
+ *  - RMS deviation of each configuration from its own mean: how much noise
+ *    there is, to judge the other numbers against.
+ *
+ * Stages before the output are replayed on one thread with the generic
+ * functions, so they are compared only when both configurations agree on
+ * threads, bands, kernel and filtering in place, which change only the
+ * output.
+ */
+
+#include <stdio.h>
+#include "secamiz0r.c"
+
+/**
+ * Things which may differ between two runs.
+ */
+struct config
+{
+    double fire_intensity;
+    double noise_intensity;
+    enum secamiz0r_format input_format;
+    unsigned int thread_count;
+    size_t band_pairs;
+    int generic_kernel;
+    int in_place;
+};
+
+/**
+ * Stages compared, and what's in the channels of each one.
+ * Stages 1 to 2.2 are in the working layout: luma, chroma (R-Y on even
+ * lines, B-Y on odd ones) and fire marks. The output is RGB.
+ */
+enum stage
+{
+    STAGE_COPY,
+    STAGE_PREFILTER,
+    STAGE_FILTER,
+    STAGE_OUTPUT,
+    STAGE_COUNT,
+};
+
+static char const *const stage_names[STAGE_COUNT] = { "copy", "prefilter", "filter", "output" };
+static char const *const channel_names[STAGE_COUNT][3] = {
+    { "Y", "C", "Z" },
+    { "Y", "C", "Z" },
+    { "Y", "C", "Z" },
+    { "R", "G", "B" },
+};
+
+/**
+ * Everything one configuration produced, and running sums over frames.
+ */
+struct run
+{
+    struct config config;
+    f0r_instance_t instance;
+    uint8_t *src;                   // source frame in the configured format
+    uint8_t *frames[STAGE_COUNT];   // stage outputs of the current frame
+    float *sums[STAGE_COUNT];       // per-pixel sums over frames, 3 channels
+    float *squares[STAGE_COUNT];    // per-pixel sums of squares
+};
+
+/**
+ * Differences between the runs, summed over frames.
+ */
+struct report
+{
+    double mse[STAGE_COUNT][3];
+    double ssim[STAGE_COUNT][3];
+};
+
+static unsigned int width = 720;
+static unsigned int height = 576;
+static size_t frame_count = 8;
+static unsigned int seed = 1;
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+        "usage: secamiz0r-quality [options] ALTERNATIVE [REFERENCE]\n"
+        "configurations are comma-separated lists of:\n"
+        "  fire=X     fire intensity (default: 0.125)\n"
+        "  noise=X    noise intensity (default: 0.125)\n"
+        "  in=FORMAT  source pixel format: rgba, uyvy, yuy2 (default: rgba)\n"
+        "  threads=N  number of threads (default: 1)\n"
+        "  band=N     row pairs per band (default: 8)\n"
+        "  kernel=K   RGBA kernel: auto, generic (default: auto)\n"
+        "  inplace=B  filter RGBA source in place of the output: 0, 1 (default: 0)\n"
+        "options:\n"
+        "  -s WxH     frame size (default: 720x576)\n"
+        "  -n N       number of frames (default: 8)\n"
+        "  -S N       seed of the source picture (default: 1)\n");
+}
+
+static int parse_config(struct config *config, char const *text)
+{
+    config->fire_intensity = 0.125;
+    config->noise_intensity = 0.125;
+    config->input_format = SECAMIZ0R_FORMAT_RGBA8888;
+    config->thread_count = 1;
+    config->band_pairs = BAND_PAIRS;
+    config->generic_kernel = 0;
+    config->in_place = 0;
+
+    while (*text) {
+        char key[16];
+        char value[32];
+        int length = 0;
+
+        if (sscanf(text, "%15[^=]=%31[^,]%n", key, value, &length) != 2) {
+            return 0;
+        }
+
+        text += length;
+
+        if (*text == ',') {
+            text++;
+        }
+
+        if (!strcmp(key, "fire")) {
+            config->fire_intensity = atof(value);
+        } else if (!strcmp(key, "noise")) {
+            config->noise_intensity = atof(value);
+        } else if (!strcmp(key, "in") && !strcmp(value, "rgba")) {
+            config->input_format = SECAMIZ0R_FORMAT_RGBA8888;
+        } else if (!strcmp(key, "in") && !strcmp(value, "uyvy")) {
+            config->input_format = SECAMIZ0R_FORMAT_UYVY;
+        } else if (!strcmp(key, "in") && (!strcmp(value, "yuy2") || !strcmp(value, "yuyv"))) {
+            config->input_format = SECAMIZ0R_FORMAT_YUY2;
+        } else if (!strcmp(key, "threads")) {
+            config->thread_count = (unsigned int) atoi(value);
+        } else if (!strcmp(key, "band") && atoi(value) > 0) {
+            config->band_pairs = (size_t) atoi(value);
+        } else if (!strcmp(key, "kernel") && (!strcmp(value, "auto") || !strcmp(value, "generic"))) {
+            config->generic_kernel = !strcmp(value, "generic");
+        } else if (!strcmp(key, "inplace") && (!strcmp(value, "0") || !strcmp(value, "1"))) {
+            config->in_place = atoi(value);
+        } else {
+            return 0;
+        }
+    }
+
+    // Packed sources can't be filtered in place of an RGBA output.
+    return !config->in_place || config->input_format == SECAMIZ0R_FORMAT_RGBA8888;
+}
+
+/**
+ * Seeded picture: gradients, hard edges and some texture.
+ */
+static void fill_source(uint8_t *rgba)
+{
+    uint32_t r = 2463534242u ^ (seed * 2654435761u);
+
+    for (unsigned int y = 0; y < height; y++) {
+        for (unsigned int x = 0; x < width; x++) {
+            uint8_t *pixel = &rgba[((size_t) y * width + x) * 4];
+            unsigned int band = ((x + seed * 16) / 64 + y / 48) % 4;
+
+            r ^= r << 13;
+            r ^= r >> 17;
+            r ^= r << 5;
+
+            pixel[0] = (uint8_t) ((x * 255) / width);
+            pixel[1] = (uint8_t) clamp_int((int) ((y * 255) / height) + (int) (r % 32) - 16, 0, 255);
+            pixel[2] = (uint8_t) (band * 85);
+            pixel[3] = 255;
+        }
+    }
+}
+
+/**
+ * Proper 4:2:2 version of the picture: each line keeps its own chroma.
+ */
+static void pack_source(uint8_t *dst, uint8_t const *rgba, struct packed_layout const *layout)
+{
+    for (size_t i = 0; i < (size_t) width * height; i += 2) {
+        float rgb0[3];
+        float rgb1[3];
+
+        unpack_rgb(rgb0, &rgba[(i + 0) * 4]);
+        unpack_rgb(rgb1, &rgba[(i + 1) * 4]);
+
+        float rgb[] = {
+            (rgb0[0] + rgb1[0]) / 2.f,
+            (rgb0[1] + rgb1[1]) / 2.f,
+            (rgb0[2] + rgb1[2]) / 2.f,
+        };
+
+        dst[i * 2 + layout->y0] = y_from_rgb(rgb0);
+        dst[i * 2 + layout->y1] = y_from_rgb(rgb1);
+        dst[i * 2 + layout->u] = u_from_rgb(rgb);
+        dst[i * 2 + layout->v] = v_from_rgb(rgb);
+    }
+}
+
+static int setup_run(struct run *run, uint8_t const *rgba)
+{
+    size_t const pixels = (size_t) width * height;
+    struct packed_layout const *layout = get_packed_layout(run->config.input_format);
+
+    run->instance = f0r_construct(width, height);
+    run->src = malloc(pixels * 4);
+
+    if (!run->instance || !run->src || !secamiz0r_set_threads(run->instance, run->config.thread_count)) {
+        return 0;
+    }
+
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        run->frames[s] = malloc(pixels * 4);
+        run->sums[s] = calloc(pixels * 3, sizeof(float));
+        run->squares[s] = calloc(pixels * 3, sizeof(float));
+
+        if (!run->frames[s] || !run->sums[s] || !run->squares[s]) {
+            return 0;
+        }
+    }
+
+    struct secamiz0r *self = run->instance;
+
+    f0r_set_param_value(self, &run->config.fire_intensity, 0);
+    f0r_set_param_value(self, &run->config.noise_intensity, 1);
+    self->band_pairs = run->config.band_pairs;
+
+    if (run->config.generic_kernel) {
+        self->process_rgba_pair = process_rgba_pair_any;
+    }
+
+    if (layout) {
+        pack_source(run->src, rgba, layout);
+    } else {
+        memcpy(run->src, rgba, pixels * 4);
+    }
+
+    return 1;
+}
+
+static void cleanup_run(struct run *run)
+{
+    if (run->instance) {
+        f0r_destruct(run->instance);
+    }
+
+    free(run->src);
+
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        free(run->frames[s]);
+        free(run->sums[s]);
+        free(run->squares[s]);
+    }
+}
+
+/**
+ * Whether stages before the output, replayed the same way for both
+ * configurations, would show what differs between them.
+ */
+static int same_path(struct config const *a, struct config const *b)
+{
+    return a->thread_count == b->thread_count && a->band_pairs == b->band_pairs
+        && a->generic_kernel == b->generic_kernel && a->in_place == b->in_place;
+}
+
+/**
+ * Filter a frame, keeping the working rows after every stage from the
+ * first one. Stages are run here the same way process_pair() runs them,
+ * the output is taken from the real thing, with all the threads and
+ * kernels configured.
+ */
+static void filter_frame(struct run *run, size_t frame_index, int first_stage)
+{
+    struct secamiz0r *self = run->instance;
+    struct packed_layout const *layout = get_packed_layout(run->config.input_format);
+    struct pair_stats stats = { 0 };
+    struct params params;
+    size_t const src_pitch = (size_t) width * (layout ? 2 : 4);
+    size_t const pitch = (size_t) width * 4;
+
+    take_params(self, &params);
+
+    for (size_t pair = 0; first_stage < STAGE_OUTPUT && pair < height / 2; pair++) {
+        struct span const span = {
+            .frame_index = frame_index, .pair = pair, .x = 0, .width = width,
+            .stats = &stats, .params = &params, .noise = NULL,
+            .skip_left = 0, .skip_right = 0,
+        };
+        uint8_t const *src_even = &run->src[(pair * 2 + 0) * src_pitch];
+        uint8_t const *src_odd = &run->src[(pair * 2 + 1) * src_pitch];
+        uint8_t *even[STAGE_OUTPUT];
+        uint8_t *odd[STAGE_OUTPUT];
+
+        for (int s = 0; s < STAGE_OUTPUT; s++) {
+            even[s] = &run->frames[s][(pair * 2 + 0) * pitch];
+            odd[s] = &run->frames[s][(pair * 2 + 1) * pitch];
+        }
+
+        if (layout) {
+            copy_pair_from_packed(self, even[STAGE_COPY], odd[STAGE_COPY], src_even, src_odd, width, layout);
+        } else {
+            copy_pair_as_yuv(self, even[STAGE_COPY], odd[STAGE_COPY], src_even, src_odd, width);
+        }
+
+        memcpy(even[STAGE_PREFILTER], even[STAGE_COPY], pitch);
+        memcpy(odd[STAGE_PREFILTER], odd[STAGE_COPY], pitch);
+        prefilter_pair(self, even[STAGE_PREFILTER], odd[STAGE_PREFILTER], &span);
+
+        memcpy(even[STAGE_FILTER], even[STAGE_PREFILTER], pitch);
+        memcpy(odd[STAGE_FILTER], odd[STAGE_PREFILTER], pitch);
+        filter_pair(self, even[STAGE_FILTER], odd[STAGE_FILTER], &span);
+    }
+
+    if (run->config.in_place) {
+        memcpy(run->frames[STAGE_OUTPUT], run->src, pitch * height);
+        secamiz0r_update_frame(self, frame_index, run->frames[STAGE_OUTPUT], SECAMIZ0R_FORMAT_RGBA8888,
+                               run->frames[STAGE_OUTPUT], SECAMIZ0R_FORMAT_RGBA8888);
+    } else {
+        secamiz0r_update_frame(self, frame_index, run->src, run->config.input_format,
+                               run->frames[STAGE_OUTPUT], SECAMIZ0R_FORMAT_RGBA8888);
+    }
+
+    for (int s = first_stage; s < STAGE_COUNT; s++) {
+        for (size_t i = 0; i < (size_t) width * height * 3; i++) {
+            float const x = run->frames[s][(i / 3) * 4 + (i % 3)];
+
+            run->sums[s][i] += x;
+            run->squares[s][i] += x * x;
+        }
+    }
+}
+
+static double psnr_from_mse(double mse)
+{
+    return (mse > 0.0) ? (10.0 * log10((255.0 * 255.0) / mse)) : INFINITY;
+}
+
+/**
+ * Mean squared error of one channel of two frames.
+ */
+static double get_mse(uint8_t const *a, uint8_t const *b, int channel)
+{
+    double sum = 0.0;
+
+    for (size_t i = 0; i < (size_t) width * height; i++) {
+        double const d = (double) a[i * 4 + channel] - (double) b[i * 4 + channel];
+        sum += d * d;
+    }
+
+    return sum / ((double) width * height);
+}
+
+/**
+ * SSIM of one channel of two frames, over 8x8 windows with a step of 4.
+ */
+static double get_ssim(uint8_t const *a, uint8_t const *b, int channel)
+{
+    double const c1 = (0.01 * 255.0) * (0.01 * 255.0);
+    double const c2 = (0.03 * 255.0) * (0.03 * 255.0);
+    double total = 0.0;
+    size_t windows = 0;
+
+    for (unsigned int y = 0; y + 8 <= height; y += 4) {
+        for (unsigned int x = 0; x + 8 <= width; x += 4) {
+            double sa = 0.0, sb = 0.0, saa = 0.0, sbb = 0.0, sab = 0.0;
+
+            for (unsigned int j = 0; j < 8; j++) {
+                for (unsigned int i = 0; i < 8; i++) {
+                    size_t const k = ((size_t) (y + j) * width + x + i) * 4 + channel;
+                    double const pa = a[k];
+                    double const pb = b[k];
+
+                    sa += pa;
+                    sb += pb;
+                    saa += pa * pa;
+                    sbb += pb * pb;
+                    sab += pa * pb;
+                }
+            }
+
+            double const ma = sa / 64.0;
+            double const mb = sb / 64.0;
+            double const va = saa / 64.0 - ma * ma;
+            double const vb = sbb / 64.0 - mb * mb;
+            double const cov = sab / 64.0 - ma * mb;
+
+            total += ((2.0 * ma * mb + c1) * (2.0 * cov + c2)) / ((ma * ma + mb * mb + c1) * (va + vb + c2));
+            windows++;
+        }
+    }
+
+    return windows ? (total / windows) : 1.0;
+}
+
+/**
+ * PSNR of per-pixel means over all frames.
+ */
+static double get_mean_psnr(struct run const *a, struct run const *b, int stage, int channel)
+{
+    double sum = 0.0;
+
+    for (size_t i = 0; i < (size_t) width * height; i++) {
+        double const d = (a->sums[stage][i * 3 + channel] - b->sums[stage][i * 3 + channel]) / frame_count;
+        sum += d * d;
+    }
+
+    return psnr_from_mse(sum / ((double) width * height));
+}
+
+/**
+ * RMS deviation of frames from their per-pixel mean.
+ */
+static double get_noise(struct run const *run, int stage, int channel)
+{
+    double sum = 0.0;
+
+    for (size_t i = 0; i < (size_t) width * height; i++) {
+        double const mean = run->sums[stage][i * 3 + channel] / frame_count;
+        double const variance = run->squares[stage][i * 3 + channel] / frame_count - mean * mean;
+
+        sum += (variance > 0.0) ? variance : 0.0;
+    }
+
+    return sqrt(sum / ((double) width * height));
+}
+
+static void print_config(char const *name, struct config const *config)
+{
+    static char const *const formats[] = { "rgba", "uyvy", "yuy2" };
+
+    printf("# %s: fire=%g,noise=%g,in=%s,threads=%u,band=%zu,kernel=%s,inplace=%d\n",
+           name, config->fire_intensity, config->noise_intensity,
+           formats[config->input_format], config->thread_count, config->band_pairs,
+           config->generic_kernel ? "generic" : "auto", config->in_place);
+}
+
+int main(int argc, char **argv)
+{
+    char const *configs[2] = { NULL, "" };
+    int config_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        char const *arg = argv[i];
+
+        if (arg[0] != '-') {
+            if (config_count == 2) {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+
+            configs[config_count++] = arg;
+            continue;
+        }
+
+        if (!arg[1] || arg[2] || i + 1 >= argc) {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+
+        char const *value = argv[++i];
+
+        switch (arg[1]) {
+        case 's':
+            if (sscanf(value, "%ux%u", &width, &height) != 2 || width < 16 || height < 16 || (width % 2) || (height % 2)) {
+                print_usage();
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'n':
+            frame_count = (size_t) strtoul(value, NULL, 10);
+            break;
+        case 'S':
+            seed = (unsigned int) strtoul(value, NULL, 10);
+            break;
+        default:
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct run runs[2];
+
+    memset(runs, 0, sizeof(runs));
+
+    if (config_count == 0 || frame_count == 0
+        || !parse_config(&runs[0].config, configs[1]) || !parse_config(&runs[1].config, configs[0])) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    // Both runs must be configured exactly as asked.
+    setenv("SECAMIZ0R_AUTOTUNE", "0", 1);
+
+    uint8_t *rgba = malloc((size_t) width * height * 4);
+
+    if (!rgba) {
+        fprintf(stderr, "secamiz0r-quality: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    fill_source(rgba);
+
+    if (!setup_run(&runs[0], rgba) || !setup_run(&runs[1], rgba)) {
+        fprintf(stderr, "secamiz0r-quality: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    struct report report;
+    int const first_stage = same_path(&runs[0].config, &runs[1].config) ? STAGE_COPY : STAGE_OUTPUT;
+
+    memset(&report, 0, sizeof(report));
+
+    for (size_t k = 0; k < frame_count; k++) {
+        filter_frame(&runs[0], k, first_stage);
+        filter_frame(&runs[1], k, first_stage);
+
+        for (int s = first_stage; s < STAGE_COUNT; s++) {
+            for (int c = 0; c < 3; c++) {
+                report.mse[s][c] += get_mse(runs[0].frames[s], runs[1].frames[s], c);
+                report.ssim[s][c] += get_ssim(runs[0].frames[s], runs[1].frames[s], c);
+            }
+        }
+    }
+
+    print_config("reference", &runs[0].config);
+    print_config("alternative", &runs[1].config);
+    printf("# %ux%u, %zu frames, seed %u\n", width, height, frame_count, seed);
+
+    if (first_stage != STAGE_COPY) {
+        printf("# threads, band, kernel or inplace differ, which only the output shows\n");
+    }
+
+    printf("%-10s %-2s %9s %8s %12s %10s %10s\n",
+           "stage", "ch", "PSNR dB", "SSIM", "mean PSNR", "noise ref", "noise alt");
+
+    for (int s = first_stage; s < STAGE_COUNT; s++) {
+        for (int c = 0; c < 3; c++) {
+            printf("%-10s %-2s %9.2f %8.5f %12.2f %10.3f %10.3f\n",
+                   stage_names[s], channel_names[s][c],
+                   psnr_from_mse(report.mse[s][c] / frame_count),
+                   report.ssim[s][c] / frame_count,
+                   get_mean_psnr(&runs[0], &runs[1], s, c),
+                   get_noise(&runs[0], s, c),
+                   get_noise(&runs[1], s, c));
+        }
+    }
+
+    cleanup_run(&runs[0]);
+    cleanup_run(&runs[1]);
+    free(rgba);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,323 @@
+/**
+ * Copyright (c) 2024 tuorqai
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+/**
+ * secamiz0r_train.c: training workload for profile-guided optimization.
+ * Plugin modules are loaded the way a frei0r host would load them, so that
+ * profiles are collected for the modules themselves and not for a copy of
+ * the code linked into this program. The mask variant is given a mask.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "secamiz0r.h"
+
+/**
+ * Frames filtered for every combination of content and intensities.
+ */
+#define FRAMES_PER_CASE 1
+
+/**
+ * Entry points looked up in the module.
+ */
+struct module
+{
+    void *handle;
+    f0r_instance_t (*construct)(unsigned int width, unsigned int height);
+    void (*destruct)(f0r_instance_t instance);
+    void (*set_param_value)(f0r_instance_t instance, f0r_param_t param, int index);
+    void (*update)(f0r_instance_t instance, double time, uint32_t const *src, uint32_t *dst);
+    void (*update2)(f0r_instance_t instance, double time,
+                    uint32_t const *src1, uint32_t const *src2, uint32_t const *src3, uint32_t *dst);
+    void (*update_format)(f0r_instance_t instance, double time,
+                          void const *src, enum secamiz0r_format src_format,
+                          void *dst, enum secamiz0r_format dst_format);
+};
+
+/**
+ * Frame sizes seen in practice: SD, HD, Full HD, and something odd.
+ */
+static unsigned int const sizes[][2] = {
+    { 720, 576 },
+    { 1280, 720 },
+    { 1920, 1080 },
+    { 1000, 562 },
+};
+
+/**
+ * Intensities from "barely visible" to "broken TV", both parameters
+ * change which branches of the row pair loops are taken.
+ */
+static double const intensities[] = { 0.0, 0.25, 1.0 };
+
+/**
+ * Kinds of picture content.
+ */
+enum content
+{
+    CONTENT_PICTURE,    // gradients with sharp edges
+    CONTENT_NOISE,      // lots of luma transitions, lots of fire
+    CONTENT_FLAT,       // no transitions at all
+    CONTENT_SATURATED,  // bright and colourful, clamps a lot
+    CONTENT_COUNT,
+};
+
+static int load_module(struct module *module, char const *path)
+{
+    module->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+
+    if (!module->handle) {
+        fprintf(stderr, "secamiz0r-train: %s\n", dlerror());
+        return 0;
+    }
+
+    *(void **) &module->construct = dlsym(module->handle, "f0r_construct");
+    *(void **) &module->destruct = dlsym(module->handle, "f0r_destruct");
+    *(void **) &module->set_param_value = dlsym(module->handle, "f0r_set_param_value");
+    *(void **) &module->update = dlsym(module->handle, "f0r_update");
+    *(void **) &module->update2 = dlsym(module->handle, "f0r_update2");
+    *(void **) &module->update_format = dlsym(module->handle, "secamiz0r_update_format");
+
+    if (!module->construct || !module->destruct || !module->set_param_value || !module->update) {
+        fprintf(stderr, "secamiz0r-train: %s is not a frei0r plugin\n", path);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Monotonic time in seconds.
+ */
+static double get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void fill_frame(uint32_t *frame, unsigned int width, unsigned int height, enum content content, unsigned int seed)
+{
+    uint32_t r = 2463534242u + seed;
+
+    for (unsigned int y = 0; y < height; y++) {
+        for (unsigned int x = 0; x < width; x++) {
+            uint8_t *pixel = (uint8_t *) &frame[y * width + x];
+            unsigned int band = ((x + seed * 16) / 64 + y / 48) % 4;
+
+            r ^= r << 13;
+            r ^= r >> 17;
+            r ^= r << 5;
+
+            switch (content) {
+            case CONTENT_PICTURE:
+                pixel[0] = (uint8_t) ((x * 255) / width);
+                pixel[1] = (uint8_t) ((y * 255) / height);
+                pixel[2] = (uint8_t) (band * 85);
+                break;
+            case CONTENT_NOISE:
+                pixel[0] = (uint8_t) r;
+                pixel[1] = (uint8_t) (r >> 8);
+                pixel[2] = (uint8_t) (r >> 16);
+                break;
+            case CONTENT_FLAT:
+                pixel[0] = 96;
+                pixel[1] = 96;
+                pixel[2] = 128;
+                break;
+            default:
+                pixel[0] = (band & 1) ? 255 : 0;
+                pixel[1] = (band & 2) ? 255 : 32;
+                pixel[2] = 255;
+                break;
+            }
+
+            pixel[3] = 255;
+        }
+    }
+}
+
+/**
+ * Mask for the mixer variant: a disc in the middle of the frame with
+ * a soft edge, so that rows are filtered partly, blended, or not at all.
+ */
+static void fill_mask(uint32_t *frame, unsigned int width, unsigned int height)
+{
+    int const radius = (int) height / 3;
+
+    for (unsigned int y = 0; y < height; y++) {
+        for (unsigned int x = 0; x < width; x++) {
+            uint8_t *pixel = (uint8_t *) &frame[y * width + x];
+            int const dx = (int) x - (int) width / 2;
+            int const dy = (int) y - (int) height / 2;
+
+            // About 16 levels per pixel across the edge.
+            int const weight = (radius * radius - dx * dx - dy * dy) * 8 / radius;
+            uint8_t const value = (uint8_t) ((weight < 0) ? 0 : (weight > 255) ? 255 : weight);
+
+            pixel[0] = value;
+            pixel[1] = value;
+            pixel[2] = value;
+            pixel[3] = 255;
+        }
+    }
+}
+
+/**
+ * Filter a few frames of every content with every pair of intensities,
+ * then a few frames in packed formats, which go through the generic
+ * row pair path. Threads are left alone: they only change how rows are
+ * dealt out, not how they are filtered.
+ */
+static int train_size(struct module const *module, unsigned int width, unsigned int height)
+{
+    size_t const pixels = (size_t) width * height;
+    uint32_t *src = malloc(pixels * 4);
+    uint32_t *dst = malloc(pixels * 4);
+    uint32_t *mask = module->update2 ? malloc(pixels * 4) : NULL;
+    f0r_instance_t instance = module->construct(width, height);
+
+    if (!src || !dst || (module->update2 && !mask) || !instance) {
+        free(src);
+        free(dst);
+        free(mask);
+        return 0;
+    }
+
+    if (mask) {
+        fill_mask(mask, width, height);
+    }
+
+    size_t frames = 0;
+    double const t0 = get_time();
+
+    for (int content = 0; content < CONTENT_COUNT; content++) {
+        fill_frame(src, width, height, (enum content) content, (unsigned int) content);
+
+        for (size_t i = 0; i < sizeof(intensities) / sizeof(*intensities); i++) {
+            for (size_t j = 0; j < sizeof(intensities) / sizeof(*intensities); j++) {
+                double fire = intensities[i];
+                double noise = intensities[j];
+
+                module->set_param_value(instance, &fire, 0);
+                module->set_param_value(instance, &noise, 1);
+
+                for (int k = 0; k < FRAMES_PER_CASE; k++) {
+                    if (mask) {
+                        module->update2(instance, (double) frames, src, mask, NULL, dst);
+                    } else {
+                        module->update(instance, (double) frames, src, dst);
+                    }
+
+                    frames++;
+                }
+            }
+        }
+    }
+
+    if (module->update_format) {
+        static enum secamiz0r_format const formats[] = { SECAMIZ0R_FORMAT_UYVY, SECAMIZ0R_FORMAT_YUY2 };
+
+        fill_frame(src, width, height, CONTENT_PICTURE, 0);
+
+        for (size_t i = 0; i < sizeof(formats) / sizeof(*formats); i++) {
+            for (int k = 0; k < FRAMES_PER_CASE; k++) {
+                module->update_format(instance, (double) frames, src, formats[i], dst, formats[i]);
+                module->update_format(instance, (double) frames, src, SECAMIZ0R_FORMAT_RGBA8888, dst, formats[i]);
+                frames += 2;
+            }
+        }
+    }
+
+    double const elapsed = get_time() - t0;
+
+    printf("%5ux%-5u %6zu frames %9.3f ms/frame\n", width, height, frames, 1e3 * elapsed / frames);
+
+    module->destruct(instance);
+    free(src);
+    free(dst);
+    free(mask);
+
+    return 1;
+}
+
+/**
+ * Run the whole workload on one module.
+ */
+static int train_module(char const *path)
+{
+    struct module module;
+
+    if (!load_module(&module, path)) {
+        return 0;
+    }
+
+    printf("%s\n", path);
+
+    double const t0 = get_time();
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+        if (!train_size(&module, sizes[i][0], sizes[i][1])) {
+            fprintf(stderr, "secamiz0r-train: out of memory\n");
+            return 0;
+        }
+    }
+
+    printf("total %.3f s\n", get_time() - t0);
+
+    // The profile is written when the module is unloaded.
+    dlclose(module.handle);
+
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    // Every module of this build, unless some are given.
+    static char const *const built[] = {
+        SECAMIZ0R_MODULE,
+#ifdef SECAMIZ0R_MASK_MODULE
+        SECAMIZ0R_MASK_MODULE,
+#endif
+    };
+
+    char const *const *paths = (argc > 1) ? (char const *const *) &argv[1] : built;
+    size_t const count = (argc > 1) ? (size_t) (argc - 1) : sizeof(built) / sizeof(*built);
+
+    if (argc > 1 && argv[1][0] == '-') {
+        fprintf(stderr, "usage: secamiz0r-train [MODULE...]\n");
+        return EXIT_FAILURE;
+    }
+
+    // Timings of an instrumented build are no good for the autotuner.
+    setenv("SECAMIZ0R_AUTOTUNE", "0", 1);
+
+    for (size_t i = 0; i < count; i++) {
+        if (!train_module(paths[i])) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}